@@ -0,0 +1,157 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file aws_chunked.h
+ * \brief declaration of AwsChunkedEncoder class signing upload payloads
+ * chunk by chunk and appending checksum trailers with "aws-chunked" content
+ * encoding.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include "aws_sign.h"
+#include "checksum.h"
+
+namespace sss {
+
+/// Streaming SigV4 payload signature (STREAMING-AWS4-HMAC-SHA256-PAYLOAD).
+///
+/// Payload data is pulled from a source read function, the same type of
+/// function libcurl invokes, and encoded as a sequence of chunks:
+/// hex size;chunk-signature=signature\\r\\n data \\r\\n, terminated by an empty
+/// chunk. The signature of each chunk is computed from the one of the
+/// previous chunk, the first from the signature of the request headers, so
+/// the payload is hashed and signed while it is sent, in a single read of
+/// the data. Chunks are buffered since the signature precedes the data.
+///
+/// When the request declares an "x-amz-trailer" checksum header the CRC of
+/// the payload is computed in the same pass and sent after the last chunk,
+/// with a signature (STREAMING-AWS4-HMAC-SHA256-PAYLOAD-TRAILER) or without
+/// signing chunks nor trailer (STREAMING-UNSIGNED-PAYLOAD-TRAILER).
+class AwsChunkedEncoder {
+   public:
+    /// Function reading payload data: same arguments and return value as
+    /// \e libcurl read functions, values greater than the requested size
+    /// signal an error
+    using ReadFunction = size_t (*)(void* ptr, size_t size, size_t nmemb,
+                                    void* userdata);
+    /// Min size of all the chunks but the last
+    static constexpr size_t MIN_CHUNK_SIZE = 8 << 10;
+    /// Constructor
+    /// \param signer signer used to sign the request headers
+    /// \param signedHeaders headers returned by SignStreamingHeaders
+    /// \param chunkSize size of payload data in each chunk
+    AwsChunkedEncoder(const SigV4Signer& signer, const Map& signedHeaders,
+                      size_t chunkSize)
+        : AwsChunkedEncoder(&signer, signedHeaders, chunkSize) {}
+    /// Constructor for unsigned chunks followed by a checksum trailer
+    /// \param signedHeaders headers returned by SignStreamingHeaders
+    /// \param chunkSize size of payload data in each chunk
+    AwsChunkedEncoder(const Map& signedHeaders, size_t chunkSize)
+        : AwsChunkedEncoder(nullptr, signedHeaders, chunkSize) {}
+    /// Disable copy constructor
+    AwsChunkedEncoder(const AwsChunkedEncoder&) = delete;
+    /// Return size of encoded payload
+    /// \param payloadHash "x-amz-content-sha256" value
+    /// \param trailer "x-amz-trailer" value, empty if none
+    static size_t EncodedSize(
+        size_t payloadSize, size_t chunkSize,
+        const std::string& payloadHash = STREAMING_PAYLOAD,
+        const std::string& trailer = "");
+    /// Return size of encoded payload
+    size_t EncodedSize() const {
+        return EncodedSize(payloadSize_, chunkSize_, payloadHash_, trailer_);
+    }
+    /// Return checksum of payload sent in trailer, \c nullptr if none;
+    /// complete once the whole payload was read
+    const Checksum* PayloadChecksum() const {
+        return trailer_.empty() ? nullptr : &checksum_;
+    }
+    /// Set function reading payload data
+    void SetSource(ReadFunction read, void* data) {
+        read_ = read;
+        readData_ = data;
+    }
+    /// Return function reading payload data
+    ReadFunction SourceFunction() const { return read_; }
+    /// Return data passed to source read function
+    void* SourceData() const { return readData_; }
+    /// \brief Copy encoded data into buffer, reading next chunk if needed.
+    ///
+    /// \param ptr output buffer
+    /// \param size max number of bytes to copy
+    /// \return number of bytes copied, zero at end of payload, -1 on error
+    ssize_t Read(char* ptr, size_t size);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    /// max length of chunk header: 16 hex digits, extension, signature, CRLF
+    static constexpr size_t MAX_HEADER_SIZE =
+        16 + 17 + SigV4Signer::SIGNATURE_SIZE + 2;
+    /// max length of trailer: checksum and signature lines, CRLF
+    static constexpr size_t MAX_TRAILER_SIZE =
+        64 + 24 + SigV4Signer::SIGNATURE_SIZE + 6;
+    AwsChunkedEncoder(const SigV4Signer* signer, const Map& signedHeaders,
+                      size_t chunkSize);
+    bool NextChunk();
+    size_t WriteTrailer(char* out);
+    const SigV4Signer* signer_;  ///< \c nullptr if chunks are not signed
+    std::string payloadHash_;    ///< "x-amz-content-sha256" of request
+    std::string trailer_;        ///< checksum header name, empty if none
+    Checksum checksum_;          ///< of payload read so far
+    std::string timeStamp_;  ///< "x-amz-date" of request
+    char signature_[SigV4Signer::SIGNATURE_SIZE];  ///< of previous chunk
+    size_t payloadSize_ = 0;
+    size_t chunkSize_;
+    size_t remaining_ = 0;  ///< payload bytes not read yet
+    ReadFunction read_ = nullptr;
+    void* readData_ = nullptr;
+    /// encoded chunk: header placed right before the data, then CRLF
+    std::vector<char> buffer_;
+    size_t begin_ = 0;  ///< next byte of encoded chunk to copy
+    size_t end_ = 0;    ///< one past last byte of encoded chunk
+    bool last_ = false;  ///< \c true after the empty chunk was encoded
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
@@ -38,6 +38,7 @@
 
 #pragma once
 #include <string>
+#include <string_view>
 #include "common.h"
 
 namespace sss {
@@ -80,4 +81,116 @@ struct SignHeadersInfo {
 /// instead of multiple parameters
 Map SignHeaders(const SignHeadersInfo& hi);
 
+/// Header name and value referencing memory owned by the caller
+struct HeaderSpan {
+    std::string_view name;   ///< lowercase header name
+    std::string_view value;  ///< header value, no leading or trailing spaces
+};
+
+/// Request to sign with SigV4Signer
+struct SigV4Request {
+    std::string_view method;          ///< uppercase HTTP method
+    std::string_view canonicalURI;    ///< "/bucket/key"
+    std::string_view canonicalQuery;  ///< url encoded parameters sorted by key
+    /// signed headers sorted by name, must include "host", "x-amz-date"
+    /// and "x-amz-content-sha256"
+    const HeaderSpan* headers = nullptr;
+    size_t numHeaders = 0;                            ///< number of headers
+    std::string_view payloadHash{"UNSIGNED-PAYLOAD"};  ///< payload SHA256
+    std::string_view timeStamp;  ///< "x-amz-date" value
+};
+
+/// \brief Signer computing the Authorization header without allocating
+/// memory once the output string has reached its final capacity.
+///
+/// Credentials, region and service are validated once at construction, the
+/// canonical request is hashed while it is generated instead of being
+/// stored and the string to sign is built on the stack. Thread safe.
+class SigV4Signer {
+   public:
+    /// Length of "x-amz-date" timestamp: YYYYMMDDTHHMMSSZ
+    static constexpr size_t TIMESTAMP_SIZE = 16;
+    /// Length of hex encoded signature
+    static constexpr size_t SIGNATURE_SIZE = 64;
+    /// Constructor
+    SigV4Signer(const std::string& accessKey, const std::string& secretKey,
+                const std::string& region = "us-east-1",
+                const std::string& service = "s3");
+    /// Write current UTC time in "x-amz-date" format, NUL terminated
+    static void TimeStamp(char (&ts)[TIMESTAMP_SIZE + 1]);
+    /// Compute value of Authorization header
+    /// \param req request, headers must be sorted by name
+    /// \param authorization output, previous content is replaced
+    void Sign(const SigV4Request& req, std::string& authorization) const;
+    /// Compute signature of chunk of streaming payload
+    /// \param timeStamp "x-amz-date" value of request
+    /// \param previous signature of previous chunk, signature of request
+    /// headers for the first chunk
+    /// \param chunkHash hex encoded SHA256 of chunk data
+    /// \param signature SIGNATURE_SIZE characters output, not NUL terminated
+    void SignChunk(std::string_view timeStamp, std::string_view previous,
+                   std::string_view chunkHash, char* signature) const;
+    /// Compute signature of trailing headers of streaming payload
+    /// \param timeStamp "x-amz-date" value of request
+    /// \param previous signature of last (empty) chunk
+    /// \param trailerHash hex encoded SHA256 of trailing headers, each
+    /// formatted as "name:value\n"
+    /// \param signature SIGNATURE_SIZE characters output, not NUL terminated
+    void SignTrailer(std::string_view timeStamp, std::string_view previous,
+                     std::string_view trailerHash, char* signature) const;
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    void SignStreaming(std::string_view algorithm,
+                       std::string_view timeStamp,
+                       std::string_view previous, std::string_view hashes,
+                       char* signature) const;
+    std::string accessKey_;
+    std::string secretKey_;
+    std::string region_;
+    std::string service_;
+    /**
+     * @}
+     */
+};
+
+/// Return value of "host" header for endpoint URL: host[:port]
+std::string HostHeader(const std::string& endpoint);
+
+/// Sign headers with pre-built signer; same result as the SignHeaders
+/// overload taking credentials, with no additional headers.
+/// \param host value of "host" header: host[:port]
+/// \param payloadHash hex encoded SHA256 of payload, unsigned if empty
+Map SignHeaders(const SigV4Signer& signer, const std::string& host,
+                const std::string& method, const std::string& canonicalURI,
+                const Map& parameters = Map(),
+                const std::string& payloadHash = "");
+
+/// "x-amz-content-sha256" value of payloads signed chunk by chunk
+extern const char STREAMING_PAYLOAD[];
+/// "x-amz-content-sha256" value of payloads signed chunk by chunk followed
+/// by signed trailing headers
+extern const char STREAMING_PAYLOAD_TRAILER[];
+/// "x-amz-content-sha256" value of unsigned chunked payloads followed by
+/// trailing headers
+extern const char STREAMING_UNSIGNED_PAYLOAD_TRAILER[];
+
+/// Sign headers of request whose payload is sent with "aws-chunked" encoding,
+/// see AwsChunkedEncoder; the returned headers include "content-encoding"
+/// and "x-amz-decoded-content-length".
+/// \param host value of "host" header: host[:port]
+/// \param payloadSize size of payload before encoding
+/// \param trailer name of header sent after the payload, e.g.
+/// "x-amz-checksum-crc32c", none if empty
+/// \param signChunks sign chunks and trailer; if false a trailer is required
+Map SignStreamingHeaders(const SigV4Signer& signer, const std::string& host,
+                         const std::string& method,
+                         const std::string& canonicalURI, size_t payloadSize,
+                         const Map& parameters = Map(),
+                         const std::string& trailer = "",
+                         bool signChunks = true);
+
 } // namespace
\ No newline at end of file
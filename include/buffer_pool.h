@@ -0,0 +1,121 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file buffer_pool.h
+ * \brief declaration of BufferPool class recycling page aligned buffers
+ * within a memory budget.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace sss {
+
+/// Pool of page aligned buffers of equal size.
+///
+/// Buffers are allocated on demand until the memory budget is reached,
+/// afterwards callers wait for a buffer to be returned; released buffers
+/// are kept for reuse and only unmapped when the pool is destroyed, so that
+/// resident memory is bounded by the budget.
+class BufferPool {
+   public:
+    /// Buffer owned by caller, returned to pool on destruction.
+    class Buffer {
+       public:
+        /// Default constructor, empty buffer
+        Buffer() = default;
+        /// Disable copy constructor
+        Buffer(const Buffer&) = delete;
+        /// Move constructor
+        Buffer(Buffer&& other) noexcept;
+        /// Move assignment, returns current buffer to pool
+        Buffer& operator=(Buffer&& other) noexcept;
+        /// Destructor, returns buffer to pool
+        ~Buffer();
+        /// Pointer to page aligned memory
+        char* Data() const { return data_; }
+        /// Buffer size
+        size_t Size() const;
+        /// \c true if buffer is not empty
+        explicit operator bool() const { return data_ != nullptr; }
+
+       private:
+        friend class BufferPool;
+        Buffer(BufferPool* pool, char* data) : pool_(pool), data_(data) {}
+        BufferPool* pool_ = nullptr;  ///< owner
+        char* data_ = nullptr;        ///< memory
+    };
+    /// Constructor
+    /// \param bufferSize size of each buffer, rounded up to page size or to
+    /// huge page size when huge pages are requested
+    /// \param budget max memory allocated, at least one buffer is allocated
+    /// \param hugePages back buffers with huge pages if available,
+    /// transparent huge pages are requested otherwise
+    BufferPool(size_t bufferSize, size_t budget, bool hugePages = false);
+    /// Disable copy constructor
+    BufferPool(const BufferPool&) = delete;
+    /// Destructor, all buffers must have been returned
+    ~BufferPool();
+    /// Return buffer, waiting for one to be released if budget is exhausted
+    Buffer Acquire();
+    /// Return buffer or empty buffer if budget is exhausted
+    Buffer TryAcquire();
+    /// Size of each buffer
+    size_t BufferSize() const { return bufferSize_; }
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    Buffer Take(std::unique_lock<std::mutex>& lock);
+    char* Allocate();
+    void Release(char* data);
+
+   private:
+    size_t bufferSize_;       ///< size of each buffer
+    size_t maxBuffers_;       ///< number of buffers within budget
+    bool hugePages_;          ///< allocate with MAP_HUGETLB
+    size_t allocated_ = 0;    ///< buffers allocated
+    std::vector<char*> free_;  ///< buffers available for reuse
+    std::mutex mutex_;        ///< protects allocated_ and free_
+    std::condition_variable released_;  ///< signalled on Release
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
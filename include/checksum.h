@@ -0,0 +1,104 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file checksum.h
+ * \brief declaration of Checksum class computing the CRC checksums
+ * supported by S3.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sss {
+
+/// CRC algorithms supported by S3 full object checksums
+enum class ChecksumAlgorithm { CRC32C, CRC64NVME };
+
+/// Incremental CRC checksum.
+///
+/// CRC32C is computed with the SSE4.2 \c crc32 instruction on three
+/// interleaved streams, CRC64NVME by folding with carry-less multiplication
+/// (PCLMULQDQ); on CPUs without them with slicing-by-8 tables. Checksums of
+/// consecutive data are combined without reading the data again, which is
+/// how the checksum of a multipart object is computed from the checksums of
+/// its parts.
+class Checksum {
+   public:
+    /// Constructor
+    explicit Checksum(ChecksumAlgorithm algorithm = ChecksumAlgorithm::CRC32C)
+        : algorithm_(algorithm) {}
+    /// Add data
+    void Add(const void* data, size_t size);
+    /// Append checksum of data following the data added so far; throws
+    /// \c std::invalid_argument if the algorithms differ
+    void Combine(const Checksum& next);
+    /// Return checksum of the data added so far
+    uint64_t Value() const { return crc_; }
+    /// Return number of bytes added
+    uint64_t Size() const { return size_; }
+    /// Return algorithm
+    ChecksumAlgorithm Algorithm() const { return algorithm_; }
+    /// Return value of "x-amz-checksum-*" headers: base64 encoded big
+    /// endian checksum
+    std::string Base64() const;
+    /// Name of implementation in use: "sse4.2", "pclmul" or "table"
+    static const char* Backend(ChecksumAlgorithm algorithm);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    ChecksumAlgorithm algorithm_;
+    uint64_t crc_ = 0;   ///< checksum, pre and post inverted
+    uint64_t size_ = 0;  ///< bytes added
+    /**
+     * @}
+     */
+};
+
+/// Return algorithm name used by S3: "CRC32C" or "CRC64NVME"
+const char* ChecksumName(ChecksumAlgorithm algorithm);
+
+/// Return name of header carrying the checksum: "x-amz-checksum-crc32c"
+/// or "x-amz-checksum-crc64nvme"
+std::string ChecksumHeader(ChecksumAlgorithm algorithm);
+
+/// Return algorithm from case insensitive name; throws
+/// \c std::invalid_argument if not supported
+ChecksumAlgorithm ParseChecksumAlgorithm(const std::string& name);
+
+}  // namespace sss
@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file concurrency_controller.h
+ * \brief declaration of ConcurrencyController class adapting the number of
+ * concurrent requests sent to each endpoint.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "retry_policy.h"
+
+namespace sss {
+
+/// Per-endpoint concurrency limit with additive increase and multiplicative
+/// decrease (AIMD).
+///
+/// The window of each endpoint starts at one request and doubles every
+/// round trip until the first decrease (slow start), then grows by one
+/// request per round trip. It is halved, at most once per round trip, when
+/// the endpoint throttles requests (HTTP 429, 503 SlowDown) or transient
+/// errors occur. The window does not grow while the throughput of single
+/// requests is lower than half of the best observed, i.e. when the network
+/// path or the endpoint is saturated.
+///
+/// Thread safe, a single instance is shared by all the threads sending
+/// requests.
+class ConcurrencyController {
+   public:
+    using Clock = std::chrono::steady_clock;
+    /// Constructor
+    /// \param maxConcurrency max number of concurrent requests per endpoint
+    explicit ConcurrencyController(int maxConcurrency);
+    /// Disable copy constructor
+    ConcurrencyController(const ConcurrencyController&) = delete;
+    /// Wait until a request can be sent to endpoint and reserve slot
+    void Acquire(const std::string& endpoint);
+    /// Reserve slot if a request can be sent to endpoint without waiting
+    /// \return \c true if slot reserved
+    bool TryAcquire(const std::string& endpoint);
+    /// Release slot reserved through Acquire or TryAcquire
+    void Release(const std::string& endpoint);
+    /// \brief Update window with outcome of request.
+    ///
+    /// \param endpoint endpoint
+    /// \param status request status
+    /// \param httpStatus HTTP status code
+    /// \param seconds request duration
+    /// \param bytes number of bytes transferred
+    void Update(const std::string& endpoint, RequestStatus status,
+                long httpStatus, double seconds, size_t bytes);
+    /// Current window of endpoint
+    int Window(const std::string& endpoint) const;
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    struct Endpoint {
+        double window = 1;  ///< max number of concurrent requests
+        double slowStartThreshold = 0;  ///< slow start ends at this window
+        int inFlight = 0;               ///< requests in flight
+        double bestThroughput = 0;      ///< best request throughput, bytes/s
+        double latency = 0;             ///< EWMA of request duration, s
+        Clock::time_point lastDecrease;  ///< time of last window decrease
+    };
+    Endpoint& Get(const std::string& endpoint);
+
+   private:
+    int maxConcurrency_;  ///< window upper bound
+    mutable std::mutex mutex_;  ///< serialize access to endpoints
+    std::condition_variable released_;  ///< signaled when slots are freed
+    std::unordered_map<std::string, Endpoint> endpoints_;  ///< endpoint state
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
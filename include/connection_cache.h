@@ -0,0 +1,89 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file connection_cache.h
+ * \brief declaration of ConnectionCache class wrapping a libcurl share object
+ * used to reuse connections, DNS entries and TLS sessions across WebClient
+ * instances.
+ */
+
+#pragma once
+
+#include <curl/curl.h>
+
+#include <array>
+#include <memory>
+#include <mutex>
+
+namespace sss {
+
+/// Connection, DNS and TLS session cache shared by WebClient instances.
+///
+/// libcurl does not support sharing a connection cache among concurrently
+/// running threads, each thread therefore gets its own instance through
+/// ForThread(); instances are reference counted and stay alive as long as
+/// any WebClient created in the thread is alive.
+class ConnectionCache {
+   public:
+    /// Constructor: initializes libcurl and creates share object
+    ConnectionCache();
+    /// Disable copy constructor
+    ConnectionCache(const ConnectionCache&) = delete;
+    /// Destructor
+    ~ConnectionCache();
+    /// Return share handle to pass to \c CURLOPT_SHARE
+    CURLSH* Handle() const { return share_; }
+    /// Return cache used by WebClient instances created in current thread
+    static std::shared_ptr<ConnectionCache> ForThread();
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    static void Lock(CURL* handle, curl_lock_data data,
+                     curl_lock_access access, ConnectionCache* cache);
+    static void Unlock(CURL* handle, curl_lock_data data,
+                       ConnectionCache* cache);
+
+   private:
+    CURLSH* share_ = NULL;  ///< curl share handle C pointer
+    /// one lock per shared data type, required when instances are used
+    /// from a thread other than the one that created them
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> mutexes_;
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
@@ -0,0 +1,144 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file direct_io.h
+ * \brief declaration of DirectFileSource and DirectFileSink classes
+ * reading and writing file regions with \c O_DIRECT through pooled buffers.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+
+#include "buffer_pool.h"
+
+namespace sss {
+
+/// Read file region bypassing the page cache.
+///
+/// The region is read in page aligned slices of the buffer size into a
+/// buffer taken from a BufferPool; the buffer is returned to the pool when
+/// the instance is destroyed.
+class DirectFileSource {
+   public:
+    /// Constructor
+    /// \param fname file name
+    /// \param offset offset of region
+    /// \param size region size
+    /// \param buffer buffer from pool
+    DirectFileSource(const std::string& fname, size_t offset, size_t size,
+                     BufferPool::Buffer buffer);
+    /// Disable copy constructor
+    DirectFileSource(const DirectFileSource&) = delete;
+    /// Destructor
+    ~DirectFileSource();
+    /// \brief Copy data into buffer, reading next slice if needed.
+    ///
+    /// \param ptr output buffer
+    /// \param size max number of bytes to copy
+    /// \return number of bytes copied, zero at end of region, -1 on error
+    ssize_t Read(char* ptr, size_t size);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    int fd_ = -1;                ///< file descriptor
+    BufferPool::Buffer buffer_;  ///< slice buffer
+    size_t start_;               ///< file offset of slice in buffer
+    size_t length_ = 0;          ///< valid bytes in buffer
+    size_t pos_;                 ///< offset of next byte to copy
+    size_t end_;                 ///< one past last byte of region
+    /**
+     * @}
+     */
+};
+
+/// Write data received in order to a file region bypassing the page cache.
+///
+/// Data is accumulated into a buffer taken from a BufferPool and written
+/// when the buffer is full; the parts of the region not aligned to page
+/// boundaries are written through the page cache, so that pages shared
+/// with adjacent regions are never overwritten.
+class DirectFileSink {
+   public:
+    /// Constructor, the file is created if it does not exist and it is
+    /// never truncated
+    /// \param fname file name
+    /// \param offset offset of region
+    /// \param buffer buffer from pool
+    DirectFileSink(const std::string& fname, size_t offset,
+                   BufferPool::Buffer buffer);
+    /// Disable copy constructor
+    DirectFileSink(const DirectFileSink&) = delete;
+    /// Destructor
+    ~DirectFileSink();
+    /// \brief Append data to region.
+    ///
+    /// \return \c false if an error occurred
+    bool Write(const char* data, size_t size);
+    /// \brief Write buffered data.
+    ///
+    /// \return \c false if an error occurred
+    bool Finish();
+    /// \brief Write buffered data and return the buffer, e.g. to reuse it
+    /// for another region; no data can be written afterwards.
+    BufferPool::Buffer Release();
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    void Flush(size_t size);
+    void WriteBuffered(const char* data, size_t size, size_t offset);
+
+   private:
+    std::string fname_;          ///< file name
+    int fd_ = -1;                ///< file descriptor opened with O_DIRECT
+    int bufferedFd_ = -1;  ///< file descriptor without O_DIRECT, opened lazily
+    BufferPool::Buffer buffer_;  ///< write buffer
+    size_t head_;                ///< bytes left before first page boundary
+    size_t offset_;              ///< file offset of buffer
+    size_t fill_ = 0;            ///< bytes in buffer
+    bool error_ = false;         ///< \c true if a write failed
+    bool finished_ = false;      ///< \c true after Finish()
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
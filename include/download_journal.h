@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file download_journal.h
+ * \brief declaration of DownloadJournal class recording the byte ranges of
+ * an object already written to the output file so that an interrupted
+ * download can be resumed.
+ *
+ * Journal format, one record per line, append only:
+ * \code
+ * download <object size> <etag> <bucket> <key>
+ * modified <last modified date>
+ * range <first byte> <one past last byte>
+ * ...
+ * \endcode
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sss {
+
+/// Append-only journal of the ranges of a download written to disk.
+///
+/// Each record is written with a single \c write call followed by
+/// \c fdatasync, incomplete records left by a crash are ignored when the
+/// journal is read back. Adjacent and overlapping ranges are merged.
+class DownloadJournal {
+   public:
+    /// Byte range [first, second)
+    using Range = std::pair<size_t, size_t>;
+    /// Open journal, reading existing records if the file exists
+    /// \param path journal file path
+    explicit DownloadJournal(const std::string& path);
+    /// Disable copy constructor
+    DownloadJournal(const DownloadJournal&) = delete;
+    /// Destructor, closes file
+    ~DownloadJournal();
+    /// \c true if journal contains a download record
+    bool HasDownload() const { return !etag_.empty(); }
+    /// Bucket name
+    const std::string& Bucket() const { return bucket_; }
+    /// Key name
+    const std::string& Key() const { return key_; }
+    /// Object size
+    size_t ObjectSize() const { return objectSize_; }
+    /// Object etag
+    const std::string& ETag() const { return etag_; }
+    /// Object last modified date
+    const std::string& LastModified() const { return lastModified_; }
+    /// Ranges written to the output file: {first byte, one past last byte}
+    const std::map<size_t, size_t>& Ranges() const { return ranges_; }
+    /// Ranges of the object not written yet, in order
+    std::vector<Range> Missing() const;
+    /// \brief Record download, must be invoked once before adding ranges.
+    ///
+    /// \param bucket bucket name
+    /// \param key key name
+    /// \param objectSize object size
+    /// \param etag object etag, must not be empty
+    /// \param lastModified object last modified date, empty if unknown
+    void Begin(const std::string& bucket, const std::string& key,
+               size_t objectSize, const std::string& etag,
+               const std::string& lastModified);
+    /// \brief Record range written to the output file, thread safe.
+    ///
+    /// \param begin first byte
+    /// \param end one past last byte
+    void AddRange(size_t begin, size_t end);
+    /// Delete journal file, invoked after the download completes
+    void Remove();
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    size_t Read();
+    void Merge(size_t begin, size_t end);
+    void Append(const std::string& record);
+
+   private:
+    std::string path_;          ///< journal file path
+    int fd_ = -1;               ///< journal file descriptor, append mode
+    std::mutex mutex_;          ///< serialize appends
+    std::string bucket_;        ///< bucket name
+    std::string key_;           ///< key name
+    size_t objectSize_ = 0;     ///< object size
+    std::string etag_;          ///< object etag
+    std::string lastModified_;  ///< object last modified date
+    std::map<size_t, size_t> ranges_;  ///< {begin, end}, disjoint
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
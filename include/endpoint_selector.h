@@ -0,0 +1,125 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file endpoint_selector.h
+ * \brief declaration of EndpointSelector class distributing requests among
+ * multiple endpoints according to their load and health.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "retry_policy.h"
+
+namespace sss {
+
+/// Select endpoint for each request from a list of equivalent endpoints.
+///
+/// For each endpoint the number of requests in flight, the EWMA of the
+/// request latency and of the error rate are tracked; requests are sent to
+/// the endpoint with the lowest expected completion time,
+/// <tt>(in flight + 1) * latency * (1 + error rate)</tt>. Endpoints with
+/// consecutive transient failures are taken out of rotation for a cooldown
+/// period, if all the endpoints are out of rotation the one whose cooldown
+/// expires first is selected.
+///
+/// Thread safe.
+class EndpointSelector {
+   public:
+    using Clock = std::chrono::steady_clock;
+    /// Constructor
+    /// \param endpoints endpoint URLs, must not be empty
+    /// \param cooldown time an endpoint is out of rotation after failures
+    /// \param maxFailures number of consecutive failures before an endpoint
+    /// is taken out of rotation
+    explicit EndpointSelector(
+        const std::vector<std::string>& endpoints,
+        std::chrono::seconds cooldown = std::chrono::seconds(30),
+        int maxFailures = 3);
+    /// Disable copy constructor
+    EndpointSelector(const EndpointSelector&) = delete;
+    /// Return index of least loaded healthy endpoint
+    size_t Select() const;
+    /// Return index of least loaded healthy endpoint other than \c exclude,
+    /// used for duplicates of slow requests; \c exclude is returned if it is
+    /// the only healthy endpoint
+    size_t Select(size_t exclude) const;
+    /// Record request sent to endpoint
+    /// \param i endpoint index
+    void Begin(size_t i);
+    /// Select endpoint and record request sent to it
+    /// \return endpoint index
+    size_t Acquire();
+    /// \brief Record request completion.
+    ///
+    /// \param i endpoint index
+    /// \param status request status, only transient failures are ascribed
+    /// to the endpoint
+    /// \param seconds request duration
+    void End(size_t i, RequestStatus status, double seconds);
+    /// Endpoint URL
+    const std::string& Endpoint(size_t i) const { return endpoints_[i].url; }
+    /// Number of endpoints
+    size_t Size() const { return endpoints_.size(); }
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    struct State {
+        std::string url;               ///< endpoint URL
+        int inFlight = 0;              ///< requests in flight
+        double latency = 0;            ///< EWMA of request duration, s
+        double errorRate = 0;          ///< EWMA of transient failures
+        int failures = 0;              ///< consecutive transient failures
+        Clock::time_point downUntil;  ///< out of rotation until this time
+    };
+    size_t SelectLocked(size_t exclude = SIZE_MAX) const;
+
+   private:
+    std::vector<State> endpoints_;   ///< endpoint state
+    std::chrono::seconds cooldown_;  ///< time out of rotation
+    int maxFailures_;                ///< failures before cooldown
+    mutable std::mutex mutex_;       ///< serialize access to state
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
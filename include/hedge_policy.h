@@ -0,0 +1,156 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file hedge_policy.h
+ * \brief declaration of LatencyTracker and HedgePolicy classes deciding when
+ * to send duplicate requests.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "webclient.h"
+
+namespace sss {
+
+/// Track the time per byte of the last completed transfers.
+///
+/// Transfers of different sizes are compared through their duration
+/// divided by the number of bytes transferred. Not thread safe.
+class LatencyTracker {
+   public:
+    /// Constructor
+    /// \param window number of samples kept
+    explicit LatencyTracker(size_t window = 256);
+    /// Record completed transfer
+    /// \param seconds transfer duration
+    /// \param bytes bytes transferred
+    void Add(double seconds, size_t bytes);
+    /// Number of samples
+    size_t Size() const { return samples_.size(); }
+    /// \brief Quantile of time per byte.
+    ///
+    /// \param q quantile in [0, 1]
+    /// \return seconds per byte, zero if there are no samples
+    double Quantile(double q) const;
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    std::vector<double> samples_;  ///< seconds per byte, circular buffer
+    size_t window_;                ///< max number of samples
+    size_t next_ = 0;              ///< next sample to overwrite
+    /**
+     * @}
+     */
+};
+
+/// Decide when a duplicate (hedged) request is sent.
+///
+/// A request still in flight after the configured quantile of the duration
+/// of its peers, scaled by size, is duplicated as long as the number of
+/// duplicates does not exceed a fraction of the requests sent.
+///
+/// Thread safe.
+class HedgePolicy {
+   public:
+    /// Constructor
+    /// \param budget max ratio of duplicates to requests, e.g. 0.05
+    /// \param quantile duration quantile after which a request is duplicated
+    /// \param minSamples number of completed requests required before
+    /// duplicating
+    HedgePolicy(double budget = 0.05, double quantile = 0.95,
+                size_t minSamples = 10);
+    /// Disable copy constructor
+    HedgePolicy(const HedgePolicy&) = delete;
+    /// Record request sent
+    void Started();
+    /// Record successful request
+    /// \param seconds request duration
+    /// \param bytes bytes transferred
+    void Completed(double seconds, size_t bytes);
+    /// \brief Time after which a request of the given size is duplicated.
+    ///
+    /// \return seconds, negative if there are not enough samples
+    double Delay(size_t bytes) const;
+    /// \c true if a duplicate can be sent within the budget
+    bool CanHedge() const;
+    /// Record duplicate request sent
+    void Hedged();
+    /// Number of duplicate requests sent
+    size_t Hedges() const;
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    double budget_;              ///< max ratio of duplicates to requests
+    double quantile_;            ///< duration quantile
+    size_t minSamples_;          ///< samples required to duplicate
+    LatencyTracker latency_;     ///< completed requests
+    size_t requests_ = 0;        ///< requests sent
+    size_t hedges_ = 0;          ///< duplicates sent
+    mutable std::mutex mutex_;   ///< serialize access to state
+    /**
+     * @}
+     */
+};
+
+/// \brief Send request, duplicating it if it is slow.
+///
+/// If the request is still in flight after the delay computed by the
+/// policy a duplicate built by \c hedge is sent. Both transfers are driven
+/// from the calling thread through a curl multi handle owned by the thread,
+/// reusing its connections. The first request to succeed is kept and the
+/// other one is cancelled.
+/// \param policy hedge policy
+/// \param bytes size of the transfer, used to compute the delay
+/// \param req request, replaced by the duplicate if the duplicate succeeds
+/// first
+/// \param hedge function returning the duplicate request, or \c nullptr if
+/// a duplicate cannot be sent
+/// \param done function invoked when a transfer ends, before the request
+/// is moved back into \c req, cancelled transfers included
+/// \return \c true if the request kept succeeded
+bool SendHedged(HedgePolicy& policy, size_t bytes, WebClient& req,
+                const std::function<std::unique_ptr<WebClient>()>& hedge,
+                const std::function<void(WebClient&)>& done);
+
+}  // namespace sss
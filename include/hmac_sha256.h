@@ -0,0 +1,79 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file hmac_sha256.h
+ * \brief declaration of HmacSha256 class computing HMAC-SHA256 from saved
+ * inner and outer hash states.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "sha256_fast.h"
+
+namespace sss {
+
+/// HMAC-SHA256 context for a fixed key.
+///
+/// The hash states after the key XOR ipad and key XOR opad blocks are
+/// computed once at construction, each message then only costs the
+/// compression of the message itself and of the inner hash.
+class HmacSha256 {
+   public:
+    /// Size of HMAC in bytes
+    static constexpr size_t HASH_SIZE = Sha256::HASH_SIZE;
+    /// Constructor
+    /// \param key key, hashed first if longer than the SHA-256 block size
+    /// \param size key size in bytes
+    HmacSha256(const uint8_t* key, size_t size);
+    /// Compute HMAC of data; thread safe
+    /// \param data message
+    /// \param size message size in bytes
+    /// \param out HASH_SIZE bytes output
+    void Compute(const void* data, size_t size, uint8_t* out) const;
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    Sha256 inner_;  ///< state after key XOR ipad block
+    Sha256 outer_;  ///< state after key XOR opad block
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
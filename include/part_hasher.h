@@ -0,0 +1,95 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file part_hasher.h
+ * \brief declaration of PartHasher class computing the SHA-256 of the parts
+ * of a file in groups hashed together.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "sha256_fast.h"
+
+namespace sss {
+
+/// SHA-256 of the parts of a file, used to sign part payloads.
+///
+/// With the "avx2-x8" multi-buffer backend parts are hashed on first request
+/// in groups of Sha256MultiBuffer::LANES consecutive parts, read in lockstep
+/// and hashed together, so that the parts being uploaded concurrently are
+/// hashed by a single pass instead of one pass per part. With other backends
+/// a single stream is as fast as a group, and each part is hashed by the
+/// thread requesting it, so that parts are still hashed in parallel. Hashes
+/// are kept for retries and duplicate requests.
+class PartHasher {
+   public:
+    /// Constructor
+    /// \param file file path
+    /// \param fileSize file size
+    /// \param partSize size of all the parts but the last
+    PartHasher(const std::string& file, size_t fileSize, size_t partSize);
+    /// Disable copy constructor
+    PartHasher(const PartHasher&) = delete;
+    /// Return hex encoded SHA-256 of part, hashing it, or its group, if not
+    /// already done; thread safe, throws \c std::runtime_error on read
+    /// errors.
+    const std::string& Hash(size_t part);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    static constexpr size_t GROUP_SIZE = Sha256MultiBuffer::LANES;
+    /// Read size of each part per step
+    static constexpr size_t CHUNK_SIZE = size_t(1) << 20;
+    struct Group {
+        std::once_flag hashed;
+        std::string hashes[GROUP_SIZE];
+    };
+    void HashGroup(size_t group);
+    std::string file_;
+    size_t fileSize_;
+    size_t partSize_;
+    size_t groupSize_;  ///< parts per group: GROUP_SIZE or one
+    std::unique_ptr<Group[]> groups_;
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
@@ -0,0 +1,136 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file range_scheduler.h
+ * \brief declaration of RangeScheduler class distributing byte ranges of an
+ * object to download workers.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sss {
+
+/// Work-stealing scheduler of byte ranges.
+///
+/// The object is split into fixed-size ranges, each worker starts with a
+/// contiguous block of ranges. A worker whose queue is empty steals the
+/// last range of the longest queue; when all queues are empty it splits
+/// the unfinished tail of the largest range still being transferred, the
+/// owner of that range stops when it reaches the new end.
+///
+/// Next() is invoked by workers under a lock, Advance() is lock free and
+/// can be invoked on every block of data received.
+class RangeScheduler {
+   public:
+    /// Byte range [begin, end)
+    struct Range {
+        size_t begin = 0;  ///< first byte
+        size_t end = 0;    ///< one past last byte
+    };
+    /// Constructor
+    /// \param size object size
+    /// \param rangeSize size of each range
+    /// \param numWorkers number of workers
+    /// \param minSplit min size of the tail taken from a range being
+    /// transferred, zero to disable splitting
+    RangeScheduler(size_t size, size_t rangeSize, int numWorkers,
+                   size_t minSplit = size_t(1) << 20);
+    /// \brief Constructor for a subset of the object, e.g. the ranges not
+    /// downloaded yet.
+    ///
+    /// \param ranges disjoint ranges in order, each one is split into
+    /// ranges of at most \c rangeSize bytes
+    /// \param rangeSize max size of each range
+    /// \param numWorkers number of workers
+    /// \param minSplit min size of the tail taken from a range being
+    /// transferred, zero to disable splitting
+    RangeScheduler(const std::vector<Range>& ranges, size_t rangeSize,
+                   int numWorkers, size_t minSplit = size_t(1) << 20);
+    /// \brief Assign next range to worker.
+    ///
+    /// \param worker worker index
+    /// \param[out] range range to transfer
+    /// \return \c false if there is nothing left to transfer
+    bool Next(int worker, Range& range);
+    /// \brief Record bytes received by worker.
+    ///
+    /// \param worker worker index
+    /// \param n number of bytes received
+    /// \return number of bytes still part of the worker's range, less than
+    /// \c n when the tail of the range was taken by another worker
+    size_t Advance(int worker, size_t n);
+    /// Part of the worker's range not received yet, requested by a
+    /// duplicate of a slow transfer
+    Range Remaining(int worker) const;
+    /// \brief Record worker's range as complete.
+    ///
+    /// The part not received by the worker was received by a duplicate
+    /// transfer and is not split.
+    /// \return end of the range, moved back if its tail was split
+    size_t Complete(int worker);
+    /// Number of ranges the object was split into, split tails excluded
+    size_t NumRanges() const { return numRanges_; }
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    /// Range queue and range being transferred
+    struct Worker {
+        std::deque<Range> queue;      ///< ranges not started
+        std::atomic<size_t> pos{0};   ///< next byte of current range
+        std::atomic<size_t> end{0};   ///< end of current range
+    };
+    void Init(const std::vector<Range>& ranges, size_t rangeSize,
+              int numWorkers);
+    bool Steal(Range& range);
+    bool Split(Range& range);
+
+   private:
+    std::vector<std::unique_ptr<Worker>> workers_;  ///< one per worker
+    size_t minSplit_;                               ///< min tail size
+    size_t numRanges_;                              ///< initial ranges
+    mutable std::mutex mutex_;  ///< protects queues and range ends
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
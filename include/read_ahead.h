@@ -0,0 +1,100 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file read_ahead.h
+ * \brief declaration of ReadAhead class reading a file region into a pair
+ * of buffers filled in the background.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <future>
+#include <string>
+
+namespace sss {
+
+/// Double-buffered reader of a file region.
+///
+/// The region is read in slices: while the consumer copies data out of the
+/// current slice the next one is read into the second buffer by a shared
+/// pool of I/O threads, so that disk reads overlap with network sends.
+/// Buffers are page aligned.
+class ReadAhead {
+   public:
+    /// Constructor, starts reading the first slice
+    /// \param fname file name
+    /// \param offset offset of region
+    /// \param size region size
+    /// \param sliceSize size of each buffer
+    ReadAhead(const std::string& fname, size_t offset, size_t size,
+              size_t sliceSize);
+    /// Disable copy constructor
+    ReadAhead(const ReadAhead&) = delete;
+    /// Destructor, waits for pending read
+    ~ReadAhead();
+    /// \brief Copy data into buffer, waiting for the slice to be read if
+    /// needed.
+    ///
+    /// \param ptr output buffer
+    /// \param size max number of bytes to copy
+    /// \return number of bytes copied, zero at end of region, -1 on error
+    ssize_t Read(char* ptr, size_t size);
+    /// Set number of threads used to read slices, default is four; must be
+    /// invoked before the first instance is created
+    static void SetNumThreads(int n);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    void Schedule(int buffer);
+
+   private:
+    int fd_ = -1;             ///< file descriptor
+    size_t sliceSize_;        ///< buffer size
+    size_t nextOffset_;       ///< offset of next slice to schedule
+    size_t end_;              ///< one past last byte of region
+    char* buffers_[2] = {nullptr, nullptr};  ///< slice buffers
+    int current_ = 1;         ///< buffer being consumed
+    size_t pos_ = 0;          ///< read position in current buffer
+    size_t length_ = 0;       ///< valid bytes in current buffer
+    std::future<ssize_t> pending_;  ///< read in progress
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
@@ -0,0 +1,113 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file reorder_buffer.h
+ * \brief declaration of ReorderBuffer class writing ranges received out of
+ * order to a stream in order.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace sss {
+
+/// Bounded buffer reassembling byte ranges received out of order.
+///
+/// Ranges are stored into a ring buffer at their offset modulo the
+/// capacity and written to the output in order by Drain(). A range can be
+/// stored only when it ends within \c capacity bytes of the first byte not
+/// written yet: Reserve() blocks producers until the consumer catches up,
+/// so that a slow consumer throttles the transfers.
+///
+/// Reserve(), TryReserve(), Complete() and Abort() are thread safe;
+/// Write() can be invoked concurrently for distinct reserved ranges.
+class ReorderBuffer {
+   public:
+    /// Constructor
+    /// \param fd output file descriptor, e.g. a pipe
+    /// \param capacity buffer size, must not be smaller than a range
+    ReorderBuffer(int fd, size_t capacity);
+    /// Disable copy constructor
+    ReorderBuffer(const ReorderBuffer&) = delete;
+    /// \brief Wait until range fits into the buffer.
+    ///
+    /// \param begin first byte of range
+    /// \param end one past last byte of range
+    /// \return \c false if the buffer was aborted
+    bool Reserve(size_t begin, size_t end);
+    /// Non blocking version of Reserve(), \c false if the range does not
+    /// fit yet or the buffer was aborted
+    bool TryReserve(size_t begin, size_t end);
+    /// Store data at offset within a reserved range
+    void Write(size_t offset, const char* data, size_t size);
+    /// Record reserved range as fully written
+    void Complete(size_t begin, size_t end);
+    /// \brief Write ranges to output in order until size is reached.
+    ///
+    /// \param size total number of bytes to write
+    /// \return \c false if the buffer was aborted or the output failed
+    bool Drain(size_t size);
+    /// Stop Drain() and wake up producers waiting in Reserve()
+    void Abort();
+    /// \c true if Abort() was invoked or the output failed
+    bool Aborted() const;
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    bool Fits(size_t end) const { return end <= written_ + capacity_; }
+    bool WriteOut(size_t begin, size_t end);
+
+   private:
+    int fd_;                            ///< output
+    size_t capacity_;                   ///< ring size
+    std::unique_ptr<char[]> data_;      ///< ring buffer
+    size_t written_ = 0;                ///< bytes written to output
+    size_t ready_ = 0;                  ///< end of contiguous complete data
+    std::map<size_t, size_t> complete_; ///< complete ranges past ready_
+    bool aborted_ = false;              ///< stop producers and consumer
+    mutable std::mutex mutex_;          ///< protects offsets and ranges
+    std::condition_variable space_;     ///< signalled when data written out
+    std::condition_variable ranges_;    ///< signalled when range complete
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
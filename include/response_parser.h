@@ -37,6 +37,7 @@
 
 #include <regex>
 #include <string>
+#include <vector>
 
 namespace sss {
 
@@ -46,6 +47,13 @@ namespace sss {
 /// \return \c <tag> content
 std::string XMLTag(const std::string& xml, const std::string& tag);
 
+/// Extract and return content of all XML elements with the same tag
+/// \param xml XML text
+/// \param tag \c <tag> name
+/// \return content of each \c <tag>...</tag> element, including nested tags
+std::vector<std::string> XMLElements(const std::string& xml,
+                                     const std::string& tag);
+
 /// Extract and return HTTP header
 /// \param headers text containing the header section of an HTTP payload
 /// \param header header name
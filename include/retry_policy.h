@@ -0,0 +1,98 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file retry_policy.h
+ * \brief declaration of RetryPolicy class classifying failed requests and
+ * computing the delay between retries.
+ */
+
+#pragma once
+
+#include <curl/curl.h>
+
+#include <chrono>
+
+#include "webclient.h"
+
+namespace sss {
+
+/// Outcome of a request
+enum class RequestStatus {
+    OK,     ///< request successful
+    RETRY,  ///< transient failure, request can be sent again
+    FAIL    ///< permanent failure
+};
+
+/// Retry policy with capped exponential backoff and full jitter.
+///
+/// Transient failures are throttling and server errors
+/// (HTTP 408, 429, 500, 502, 503, 504, S3 \c RequestTimeout), connection
+/// failures and resets, and timeouts; all other errors are permanent.
+/// The delay before retry \c n, starting from zero, is drawn uniformly from
+/// <tt>[0, min(maxDelay, baseDelay * 2^n)]</tt>.
+class RetryPolicy {
+   public:
+    using Duration = std::chrono::milliseconds;
+    /// Constructor
+    /// \param maxRetries max number of retries after first attempt
+    /// \param baseDelay delay upper bound of first retry
+    /// \param maxDelay delay upper bound
+    explicit RetryPolicy(int maxRetries = 2,
+                         Duration baseDelay = Duration(100),
+                         Duration maxDelay = Duration(20000));
+    /// \brief Classify request outcome.
+    ///
+    /// \param cc libcurl result code
+    /// \param httpStatus HTTP status code, zero if no response received
+    static RequestStatus Classify(CURLcode cc, long httpStatus);
+    /// Classify outcome of request sent by client, also checks S3 error code
+    static RequestStatus Classify(const WebClient& client);
+    /// \c true if request must be sent again
+    /// \param status request status
+    /// \param retry number of retries already performed
+    bool Retry(RequestStatus status, int retry) const {
+        return status == RequestStatus::RETRY && retry < maxRetries_;
+    }
+    /// Delay before retry, thread safe
+    /// \param retry number of retries already performed
+    Duration Delay(int retry) const;
+    /// Max number of retries
+    int MaxRetries() const { return maxRetries_; }
+
+   private:
+    int maxRetries_;      ///< max number of retries
+    Duration baseDelay_;  ///< delay upper bound of first retry
+    Duration maxDelay_;   ///< delay upper bound
+};
+
+}  // namespace sss
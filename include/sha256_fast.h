@@ -0,0 +1,123 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file sha256_fast.h
+ * \brief declaration of Sha256 and Sha256MultiBuffer classes computing
+ * SHA-256 with the fastest implementation supported by the CPU.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sss {
+
+/// Incremental SHA-256.
+///
+/// Blocks are compressed by a backend selected once through CPUID: x86 SHA
+/// extensions, then AVX2/BMI2, then portable C++.
+class Sha256 {
+   public:
+    /// Block size in bytes
+    static constexpr size_t BLOCK_BYTES = 64;
+    /// Hash size in bytes
+    static constexpr size_t HASH_SIZE = 32;
+    /// Constructor
+    Sha256() { Reset(); }
+    /// Restart hashing
+    void Reset();
+    /// Add data
+    void Add(const void* data, size_t size);
+    /// Write hash of the data added so far; more data can still be added
+    /// \param out HASH_SIZE bytes output
+    void Hash(uint8_t* out) const;
+    /// Return hex encoded hash of the data added so far
+    std::string HexHash() const;
+    /// Name of backend in use: "sha-ni", "avx2" or "portable"
+    static const char* Backend();
+
+   private:
+    friend class Sha256MultiBuffer;
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    uint32_t state_[8];           ///< hash of blocks compressed so far
+    uint8_t buffer_[BLOCK_BYTES];  ///< partial block
+    size_t bufferSize_;           ///< bytes in buffer_
+    uint64_t numBytes_;           ///< total bytes added
+    /**
+     * @}
+     */
+};
+
+/// SHA-256 of up to LANES independent streams hashed together.
+///
+/// On CPUs with AVX2 but without the SHA extensions blocks of eight streams
+/// are compressed together, one stream per 32 bit lane; otherwise streams
+/// are hashed one after the other with the Sha256 backend.
+class Sha256MultiBuffer {
+   public:
+    /// Max number of streams
+    static constexpr size_t LANES = 8;
+    /// Add data to streams
+    /// \param data data of each of the LANES streams
+    /// \param sizes size of data, zero for streams not updated
+    void Add(const void* const* data, const size_t* sizes);
+    /// Write hash of stream
+    /// \param lane stream index
+    /// \param out Sha256::HASH_SIZE bytes output
+    void Hash(size_t lane, uint8_t* out) const { lanes_[lane].Hash(out); }
+    /// Return hex encoded hash of stream
+    std::string HexHash(size_t lane) const { return lanes_[lane].HexHash(); }
+    /// Name of backend in use: "avx2-x8" or "serial"
+    static const char* Backend();
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    Sha256 lanes_[LANES];  ///< state of each stream
+    /**
+     * @}
+     */
+};
+
+/// Hex encoded SHA-256 hash of data, e.g. for the x-amz-content-sha256
+/// header of signed payloads
+std::string Sha256Hex(const void* data, size_t size);
+
+}  // namespace sss
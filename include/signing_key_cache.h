@@ -0,0 +1,121 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file signing_key_cache.h
+ * \brief declaration of SigningKeyCache class storing derived AWS signature
+ * version 4 signing keys.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "hmac_sha256.h"
+
+namespace sss {
+
+/// Derived signing key and HMAC context keyed with it
+struct SigningKey {
+    std::vector<uint8_t> key;  ///< derived key
+    HmacSha256 hmac;           ///< HMAC-SHA256 of string to sign
+};
+
+/// Cache of signing keys derived from (secret, date, region, service).
+///
+/// Deriving a signing key takes four chained HMAC-SHA256 computations and
+/// gives the same result for all the requests signed on the same UTC day.
+/// Lookups are lock free: entries are immutable and published through
+/// atomic pointers, one slot per (secret, region, service) tuple; a new
+/// date replaces the entry in the same slot, which is how the cache is
+/// invalidated at date rollover. A concurrent reader might still be using a
+/// replaced entry, which is therefore freed by a later miss only one day
+/// after it was replaced: the cache holds at most \c NUM_SLOTS entries in
+/// use plus the entries replaced during the last day, i.e. two per tuple
+/// when no more than \c NUM_SLOTS tuples are in use.
+class SigningKeyCache {
+   public:
+    /// Key derivation function
+    using Derive = std::vector<uint8_t> (*)(const std::string& secret,
+                                            const std::string& date,
+                                            const std::string& region,
+                                            const std::string& service);
+    /// Constructor
+    /// \param derive function computing the key on cache miss
+    explicit SigningKeyCache(Derive derive) : derive_(derive) {}
+    /// Disable copy constructor
+    SigningKeyCache(const SigningKeyCache&) = delete;
+    /// Return signing key, computing it if not cached; thread safe.
+    /// The returned reference stays valid for at least one day.
+    const SigningKey& Get(const std::string& secret,
+                                    const std::string& date,
+                                    const std::string& region,
+                                    const std::string& service);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    /// Immutable cache entry
+    struct Entry {
+        std::string secret;
+        std::string date;
+        std::string region;
+        std::string service;
+        SigningKey key;
+    };
+    /// Entry replaced in its slot, freed once no reader can be using it
+    struct Retired {
+        std::unique_ptr<const Entry> entry;
+        std::chrono::steady_clock::time_point time;  ///< when replaced
+    };
+    static constexpr size_t NUM_SLOTS = 16;
+    Derive derive_;  ///< key derivation function
+    std::array<std::atomic<const Entry*>, NUM_SLOTS> slots_{};
+    std::mutex entriesMutex_;  ///< protects entries_ and retired_
+    /// owns the entries published in slots_, same index
+    std::array<std::unique_ptr<const Entry>, NUM_SLOTS> entries_;
+    std::vector<Retired> retired_;  ///< replaced entries, oldest first
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
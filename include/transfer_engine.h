@@ -0,0 +1,177 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file transfer_engine.h
+ * \brief declaration of TransferEngine class driving multiple WebClient
+ * requests from a single thread through the libcurl multi socket interface.
+ *
+ * Workflow:
+ * - Create TransferEngine instance
+ * - Configure WebClient instances without invoking Send() and hand them over
+ *   through Add() or from the source function passed to Run()
+ * - Invoke Run(), completion functions are invoked from the calling thread
+ */
+
+#pragma once
+
+#include <curl/curl.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+#include "hedge_policy.h"
+#include "webclient.h"
+
+namespace sss {
+
+/// Event-driven transfer engine built on \c curl_multi_socket_action and
+/// \c epoll.
+///
+/// Each engine instance must be used from a single thread; to use multiple
+/// threads create one engine per thread.
+class TransferEngine {
+   public:
+    /// Function invoked when a transfer completes; \c ok has the same meaning
+    /// as the value returned by WebClient::Send()
+    using Completion = std::function<void(WebClient& client, bool ok)>;
+    /// Value returned by source function
+    enum class SourceStatus {
+        ADDED,  ///< one transfer added
+        WAIT,   ///< nothing to add now, ask again later
+        DONE    ///< nothing left to add
+    };
+    /// Function invoked when a transfer slot is available: must either add
+    /// one transfer and return \c ADDED, return \c WAIT when a transfer
+    /// cannot be added yet or \c DONE when there is nothing left to add
+    using Source = std::function<SourceStatus(TransferEngine& engine)>;
+    /// Function returning a duplicate of a transfer and setting its
+    /// completion function, or returning \c nullptr if a duplicate cannot
+    /// be sent now
+    using Hedge = std::function<std::unique_ptr<WebClient>(Completion& done)>;
+    /// Constructor
+    /// \param maxInFlight maximum number of transfers requested from source
+    /// function at any given time
+    explicit TransferEngine(int maxInFlight = 64);
+    /// Disable copy constructor
+    TransferEngine(const TransferEngine&) = delete;
+    /// Destructor, in-flight transfers are discarded
+    ~TransferEngine();
+    /// \brief Add transfer.
+    ///
+    /// \param client configured request, ownership is transferred to engine
+    /// \param done function invoked when the transfer completes
+    void Add(std::unique_ptr<WebClient> client, Completion done);
+    /// \brief Add transfer started after a delay, used to retry requests.
+    ///
+    /// Delayed transfers count as in flight.
+    /// \param delay time to wait before starting the transfer
+    /// \param client configured request, ownership is transferred to engine
+    /// \param done function invoked when the transfer completes
+    void AddAfter(std::chrono::milliseconds delay,
+                  std::unique_ptr<WebClient> client, Completion done);
+    /// \brief Add transfer duplicated if it is slow.
+    ///
+    /// When the transfer is in flight longer than the delay computed by the
+    /// hedge policy a duplicate returned by \c hedge is added. When one of
+    /// the two succeeds the other is cancelled; the completion function of
+    /// each is invoked, the cancelled one, or the one which failed while
+    /// the other was still in flight, has WebClient::Cancelled() set. The
+    /// cancelled one completes first.
+    /// Without a hedge policy this is the same as Add().
+    /// \param client configured request, ownership is transferred to engine
+    /// \param done function invoked when the transfer completes
+    /// \param bytes size of the transfer, used to compute the delay
+    /// \param hedge function returning the duplicate
+    void AddHedged(std::unique_ptr<WebClient> client, Completion done,
+                   size_t bytes, Hedge hedge);
+    /// Set policy deciding when transfers added with AddHedged() are
+    /// duplicated, the policy can be shared by multiple engines
+    void SetHedgePolicy(HedgePolicy* policy) { hedgePolicy_ = policy; }
+    /// \brief Run event loop.
+    ///
+    /// Returns when all the transfers are complete and the source function,
+    /// if any, returns \c DONE. While the source function returns \c WAIT
+    /// it is invoked again at least every few milliseconds.
+    /// \param source function invoked to add transfers when slots are free
+    void Run(const Source& source = Source());
+    /// Number of transfers in flight
+    size_t InFlight() const { return transfers_.size() + delayed_.size(); }
+    /// \brief Set maximum number of concurrent HTTP/2 streams per connection.
+    ///
+    /// Additional connections are opened when the limit is reached.
+    /// \param n number of streams, libcurl default is 100
+    bool SetMaxConcurrentStreams(long n);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    struct Transfer {
+        std::unique_ptr<WebClient> client;
+        Completion done;
+        Hedge hedge;               ///< set until a duplicate is added
+        size_t bytes = 0;          ///< size, used by hedge policy
+        CURL* twin = NULL;         ///< duplicate or original transfer
+        std::chrono::steady_clock::time_point start;  ///< when added
+    };
+    using Clock = std::chrono::steady_clock;
+    static int SocketCallback(CURL* easy, curl_socket_t s, int what,
+                              TransferEngine* engine, void* socketp);
+    static int TimerCallback(CURLM* multi, long timeoutMs,
+                             TransferEngine* engine);
+    void Action(curl_socket_t s, int mask);
+    void CheckCompleted();
+    void StartDelayed();
+    void CheckHedges();
+    void Cancel(CURL* easy);
+
+   private:
+    CURLM* multi_ = NULL;  ///< curl multi handle C pointer
+    int epollFd_ = -1;     ///< epoll instance
+    int maxInFlight_;      ///< max number of transfers taken from source
+    bool timerSet_ = false;        ///< \c true if libcurl requested timeout
+    Clock::time_point deadline_;  ///< when libcurl timeout expires
+    std::unordered_map<CURL*, Transfer> transfers_;  ///< in-flight transfers
+    std::multimap<Clock::time_point, Transfer> delayed_;  ///< not started yet
+    HedgePolicy* hedgePolicy_ = nullptr;  ///< when to duplicate transfers
+    bool hedgeable_ = false;  ///< some transfer has a hedge function
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file upload_journal.h
+ * \brief declaration of UploadJournal class recording the progress of a
+ * multipart upload so that an interrupted upload can be resumed.
+ *
+ * Journal format, one record per line, append only:
+ * \code
+ * upload <upload id> <file size> <part size> <mtime> <inode> <bucket> <key>
+ * part <part number> <etag>
+ * ...
+ * \endcode
+ * The modification time, in nanoseconds, and the inode of the uploaded file
+ * identify the file, so that a resumed upload does not mix parts of
+ * different file contents.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace sss {
+
+/// Append-only journal of a multipart upload.
+///
+/// Each record is written with a single \c write call followed by
+/// \c fdatasync, incomplete records left by a crash are ignored when the
+/// journal is read back.
+class UploadJournal {
+   public:
+    /// Open journal, reading existing records if the file exists
+    /// \param path journal file path
+    explicit UploadJournal(const std::string& path);
+    /// Disable copy constructor
+    UploadJournal(const UploadJournal&) = delete;
+    /// Destructor, closes file
+    ~UploadJournal();
+    /// \c true if journal contains an upload record
+    bool HasUpload() const { return !uploadId_.empty(); }
+    /// Upload id
+    const std::string& UploadId() const { return uploadId_; }
+    /// Bucket name
+    const std::string& Bucket() const { return bucket_; }
+    /// Key name
+    const std::string& Key() const { return key_; }
+    /// Size of uploaded file
+    size_t FileSize() const { return fileSize_; }
+    /// Part size
+    size_t PartSize() const { return partSize_; }
+    /// Modification time of uploaded file in nanoseconds
+    uint64_t FileTime() const { return fileTime_; }
+    /// Inode of uploaded file
+    uint64_t FileInode() const { return fileInode_; }
+    /// Completed parts: {part number, etag}
+    const std::map<int, std::string>& Parts() const { return parts_; }
+    /// \brief Record upload, must be invoked once before adding parts.
+    ///
+    /// \param uploadId upload id returned by \c CreateMultipartUpload
+    /// \param bucket bucket name
+    /// \param key key name
+    /// \param fileSize size of uploaded file
+    /// \param partSize part size
+    /// \param fileTime modification time of uploaded file in nanoseconds
+    /// \param fileInode inode of uploaded file
+    void Begin(const std::string& uploadId, const std::string& bucket,
+               const std::string& key, size_t fileSize, size_t partSize,
+               uint64_t fileTime, uint64_t fileInode);
+    /// \brief Record completed part, thread safe.
+    ///
+    /// \param partNumber part number, starting from one
+    /// \param etag etag returned by \c UploadPart
+    void AddPart(int partNumber, const std::string& etag);
+    /// Delete journal file, invoked after the upload completes
+    void Remove();
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    size_t Read();
+    void Append(const std::string& record);
+
+   private:
+    std::string path_;      ///< journal file path
+    int fd_ = -1;           ///< journal file descriptor, opened in append mode
+    std::mutex mutex_;      ///< serialize appends
+    std::string uploadId_;  ///< upload id
+    std::string bucket_;    ///< bucket name
+    std::string key_;       ///< key name
+    size_t fileSize_ = 0;   ///< uploaded file size
+    size_t partSize_ = 0;   ///< part size
+    uint64_t fileTime_ = 0;   ///< modification time of uploaded file
+    uint64_t fileInode_ = 0;  ///< inode of uploaded file
+    std::map<int, std::string> parts_;  ///< {part number, etag}
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
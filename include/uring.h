@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file uring.h
+ * \brief declaration of IOURing class, minimal wrapper of the Linux
+ * \c io_uring interface with registered buffers and files.
+ *
+ * The kernel interface is used directly through system calls, no
+ * additional library is required.
+ */
+
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace sss {
+
+/// Submission and completion queues of one \c io_uring instance.
+///
+/// Not thread safe: each instance must be used by a single thread.
+class IOURing {
+   public:
+    /// Constructor
+    /// \param entries submission queue size
+    explicit IOURing(unsigned entries);
+    /// Disable copy constructor
+    IOURing(const IOURing&) = delete;
+    /// Destructor, unmaps queues and closes ring
+    ~IOURing();
+    /// \brief Register buffers used by fixed reads and writes.
+    ///
+    /// \return \c false if buffers cannot be registered e.g. because the
+    /// locked memory limit is exceeded, operations can still be queued
+    /// passing a negative buffer index
+    bool RegisterBuffers(const std::vector<iovec>& buffers);
+    /// Unregister buffers, operations in flight are not affected
+    void UnregisterBuffers();
+    /// Register files, operations refer to the index in the array; \c -1
+    /// entries are free slots filled with UpdateFile()
+    void RegisterFiles(const std::vector<int>& fds);
+    /// Replace registered file at index, \c -1 frees the slot
+    void UpdateFile(unsigned index, int fd);
+    /// \brief Queue read into registered buffer from registered file.
+    ///
+    /// \param file index of registered file
+    /// \param buffer index of registered buffer, negative if not registered
+    /// \param data pointer inside registered buffer
+    /// \param size number of bytes to read
+    /// \param offset file offset
+    /// \param userData value returned with the completion
+    void PrepareRead(int file, int buffer, void* data, unsigned size,
+                     uint64_t offset, uint64_t userData);
+    /// Queue write from registered buffer to registered file, parameters
+    /// are the same as PrepareRead
+    void PrepareWrite(int file, int buffer, const void* data, unsigned size,
+                      uint64_t offset, uint64_t userData);
+    /// \brief Submit queued operations.
+    ///
+    /// \param waitFor number of completions to wait for
+    void Submit(unsigned waitFor = 0);
+    /// \brief Retrieve completion.
+    ///
+    /// \param userData value passed to Prepare method
+    /// \param result number of bytes transferred or \c -errno
+    /// \return \c false if no completion is available
+    bool Complete(uint64_t& userData, int& result);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    void Release();
+    io_uring_sqe* NextSQE();
+
+   private:
+    int fd_ = -1;                   ///< ring file descriptor
+    void* sqRing_ = nullptr;        ///< mapped submission ring
+    size_t sqRingSize_ = 0;         ///< submission ring mapping size
+    void* cqRing_ = nullptr;        ///< mapped completion ring
+    size_t cqRingSize_ = 0;         ///< completion ring mapping size
+    io_uring_sqe* sqes_ = nullptr;  ///< submission queue entries
+    size_t sqesSize_ = 0;           ///< entries mapping size
+    unsigned* sqHead_ = nullptr;    ///< submission queue head
+    unsigned* sqTail_ = nullptr;    ///< submission queue tail
+    unsigned sqMask_ = 0;           ///< submission ring index mask
+    unsigned* sqArray_ = nullptr;   ///< submission index array
+    unsigned* cqHead_ = nullptr;    ///< completion queue head
+    unsigned* cqTail_ = nullptr;    ///< completion queue tail
+    unsigned cqMask_ = 0;           ///< completion ring index mask
+    io_uring_cqe* cqes_ = nullptr;  ///< completion queue entries
+    unsigned toSubmit_ = 0;         ///< entries queued but not submitted
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
@@ -0,0 +1,252 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file uring_file.h
+ * \brief declaration of URingFileSource and URingFileSink classes reading
+ * and writing file regions through \c io_uring, and of URingContext class
+ * sharing one ring per thread.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "uring.h"
+
+namespace sss {
+
+/// Completion of an operation queued on the ring of a URingContext
+struct URingOp {
+    int result = 0;     ///< bytes transferred or \c -errno
+    bool done = false;  ///< completion received
+};
+
+/// \brief \c io_uring instance shared by the file regions of one thread.
+///
+/// Setting up a ring, registering files and pinning buffers costs more than
+/// transferring a small region, therefore they are reused by all the regions
+/// created by a thread. Files are kept open and registered by name and open
+/// flags, and reopened when the name refers to a different file; buffers
+/// are registered as they are allocated and recycled when released.
+/// Not thread safe: a region must be used by the thread which created it.
+class URingContext {
+   public:
+    /// Context of calling thread, created on first use
+    static std::shared_ptr<URingContext> Get();
+    /// Disable copy constructor
+    URingContext(const URingContext&) = delete;
+    /// Destructor, closes cached files and frees buffers
+    ~URingContext();
+    /// Ring shared by the regions of the thread
+    IOURing& Ring() { return ring_; }
+    /// \brief Open file, or reuse it if already open with the same flags.
+    ///
+    /// \return index of registered file
+    int AcquireFile(const std::string& fname, int flags);
+    /// Release file, which stays open for later regions
+    void ReleaseFile(int file);
+    /// File descriptor of registered file
+    int Descriptor(int file) const { return files_[file].fd; }
+    /// \brief Acquire page aligned buffer.
+    ///
+    /// \return buffer id
+    int AcquireBuffer(size_t size);
+    /// Release buffer, which is reused by later regions
+    void ReleaseBuffer(int buffer) { buffers_[buffer].used = false; }
+    /// Buffer memory
+    char* Data(int buffer) const { return buffers_[buffer].data; }
+    /// Index of registered buffer, negative if buffers are not registered
+    int Index(int buffer) const { return registered_ ? buffer : -1; }
+    /// User data of operation queued on the ring
+    static uint64_t UserData(URingOp& op) {
+        return reinterpret_cast<uint64_t>(&op);
+    }
+    /// Submit queued operations and process completions until \c op is done
+    void Wait(const URingOp& op);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    URingContext();
+    struct File {
+        std::string name;  ///< file name
+        int flags = 0;     ///< open flags
+        int fd = -1;       ///< file descriptor, -1 if slot is free
+        dev_t dev = 0;     ///< device, to detect a replaced file
+        ino_t ino = 0;     ///< inode, to detect a replaced file
+        int refs = 0;      ///< number of regions using the file
+    };
+    struct Buffer {
+        char* data;         ///< page aligned memory
+        size_t size;        ///< buffer size
+        bool used = false;  ///< acquired by a region
+    };
+    IOURing ring_;                ///< ring shared by regions
+    std::vector<File> files_;     ///< registered file slots
+    std::vector<Buffer> buffers_;  ///< buffers, registered at same index
+    bool registered_ = false;     ///< buffers registered with ring
+    /**
+     * @}
+     */
+};
+
+/// Read file region in slices through \c io_uring.
+///
+/// Up to \c queueDepth slices are read ahead into registered buffers from a
+/// registered file while the consumer copies data out of the current slice.
+/// With \c O_DIRECT reads are extended to page boundaries and the page
+/// cache is bypassed. The ring, file and buffers are shared with the other
+/// regions of the thread through URingContext.
+class URingFileSource {
+   public:
+    /// Constructor, queues the first reads
+    /// \param fname file name
+    /// \param offset offset of region
+    /// \param size region size
+    /// \param sliceSize size of each read, rounded up to page size
+    /// \param queueDepth number of slices read ahead
+    /// \param direct open file with \c O_DIRECT
+    URingFileSource(const std::string& fname, size_t offset, size_t size,
+                    size_t sliceSize, int queueDepth = 4, bool direct = false);
+    /// Disable copy constructor
+    URingFileSource(const URingFileSource&) = delete;
+    /// Destructor, waits for reads in flight
+    ~URingFileSource();
+    /// \brief Copy data into buffer, waiting for the slice to be read if
+    /// needed.
+    ///
+    /// \param ptr output buffer
+    /// \param size max number of bytes to copy
+    /// \return number of bytes copied, zero at end of region, -1 on error
+    ssize_t Read(char* ptr, size_t size);
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    void Queue(size_t slice);
+    bool Wait(size_t slice);
+    void Release();
+
+   private:
+    std::shared_ptr<URingContext> context_;  ///< ring of creating thread
+    int file_ = -1;               ///< registered file index
+    size_t sliceSize_;            ///< size of each read
+    size_t base_;                 ///< offset of first slice
+    size_t end_;                  ///< one past last byte of region
+    size_t numSlices_;            ///< number of slices in region
+    size_t alignedEnd_;           ///< end of last read
+    size_t pos_;                  ///< offset of next byte to copy
+    std::vector<int> buffers_;    ///< one buffer per slice in flight
+    std::vector<size_t> slices_;  ///< slice read into buffer
+    std::vector<URingOp> ops_;    ///< read into buffer
+    std::vector<int> results_;    ///< bytes read into buffer or -errno
+    std::vector<bool> pending_;   ///< read submitted and not processed
+    /**
+     * @}
+     */
+};
+
+/// Write data received in order to a file region through \c io_uring.
+///
+/// Data is copied into registered buffers, each full buffer is written
+/// while the next one is filled; up to \c queueDepth writes are in flight.
+/// With \c O_DIRECT the unaligned tail of the region is written through
+/// the page cache. The ring, file and buffers are shared with the other
+/// regions of the thread through URingContext.
+class URingFileSink {
+   public:
+    /// Constructor, the file is created if it does not exist and it is
+    /// never truncated
+    /// \param fname file name
+    /// \param offset offset of region
+    /// \param sliceSize size of each write, rounded up to page size
+    /// \param queueDepth number of writes in flight
+    /// \param direct open file with \c O_DIRECT, ignored when offset is not
+    /// page aligned
+    URingFileSink(const std::string& fname, size_t offset, size_t sliceSize,
+                  int queueDepth = 4, bool direct = false);
+    /// Disable copy constructor
+    URingFileSink(const URingFileSink&) = delete;
+    /// Destructor, waits for writes in flight
+    ~URingFileSink();
+    /// \brief Append data to region.
+    ///
+    /// \return \c false if an error occurred
+    bool Write(const char* data, size_t size);
+    /// \brief Write buffered data and wait for all writes to complete.
+    ///
+    /// \return \c false if an error occurred
+    bool Finish();
+
+   private:
+    /**
+     * \addtogroup internal
+     * @{
+     */
+    void Submit(size_t size);
+    void Collect(int slot);
+    void WriteTail(const char* data, size_t size, size_t offset);
+    void Release();
+
+   private:
+    std::shared_ptr<URingContext> context_;  ///< ring of creating thread
+    std::string fname_;           ///< file name
+    int file_ = -1;               ///< registered file index
+    int tailFd_ = -1;  ///< file descriptor without O_DIRECT, opened lazily
+    bool direct_;                 ///< file opened with O_DIRECT
+    size_t sliceSize_;            ///< size of each write
+    size_t offset_;               ///< offset of current buffer in file
+    std::vector<int> buffers_;    ///< one buffer per write in flight
+    std::vector<size_t> sizes_;   ///< size of write in flight
+    std::vector<size_t> offsets_;  ///< offset of write in flight
+    std::vector<URingOp> ops_;    ///< write from buffer
+    std::vector<bool> pending_;   ///< write submitted and not processed
+    int current_ = 0;             ///< buffer being filled
+    size_t fill_ = 0;             ///< bytes in current buffer
+    bool error_ = false;          ///< \c true if a write failed
+    bool finished_ = false;       ///< \c true after Finish()
+    /**
+     * @}
+     */
+};
+
+}  // namespace sss
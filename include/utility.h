@@ -64,6 +64,14 @@ RandomIndex RandomRange(int lowerBound, int upperBound);
 /// \return file size in number of bytes
 size_t FileSize(const std::string& filename);
 
+/// Parse size with optional binary unit suffix: \c 'k', \c 'M', \c 'G', \c 'T'
+/// e.g. \c "64M" or \c "64MiB" = 64 * 2^20 bytes; plain numbers are bytes
+/// \param s text
+/// \return size in number of bytes
+/// \throw std::invalid_argument if the text is invalid or the size does not
+/// fit into \c size_t
+size_t ParseSize(const std::string& s);
+
 using Dict = std::unordered_map<std::string, std::string>;
 using Toml = std::unordered_map<std::string, Dict>;
 
@@ -48,22 +48,47 @@
 
 #include <array>
 #include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "aws_chunked.h"
 #include "common.h"
+#include "connection_cache.h"
+#include "direct_io.h"
+#include "read_ahead.h"
+#include "uring_file.h"
 #include "url_utility.h"
 #include "utility.h"
 
 namespace sss {
 
+/// HTTP protocol version
+enum class HTTPVersion {
+    DEFAULT,   ///< libcurl default: HTTP/2 over TLS when available
+    HTTP_1_1,  ///< HTTP/1.1 only
+    HTTP_2,    ///< HTTP/2 negotiated through ALPN or upgrade from HTTP/1.1
+    HTTP_2_PRIOR_KNOWLEDGE  ///< HTTP/2 without negotiation, also over plain
+                            ///< HTTP (h2c)
+};
+
+/// Convert text to HTTPVersion
+/// \param v one of \c "1.1", \c "2", \c "h2c" or empty for default
+/// \return HTTP version
+HTTPVersion ParseHTTPVersion(const std::string& v);
+
 /// Sends web requests through libcurl.
 /// 
 /// Error handling is managed by having libcurl log errors into a char buffer.
 /// When a method fails returning \c false, you can extract the error message
 /// by invoking the ErrorMsg() method.
+///
+/// Connections, DNS entries and TLS sessions are reused across instances
+/// created in the same thread through a ConnectionCache.
 class WebClient {
     /// Function type invoked by \e libcurl to write received data
     using WriteFunction = size_t (*)(char* data, size_t size, size_t nmemb,
@@ -84,6 +109,32 @@ class WebClient {
         const char* data;   ///< buffer
         size_t size = 0;    ///< buffer size
     };
+    /// File region read through \c pread, owned by the client so that the
+    /// request can be sent after the upload method returns.
+    struct FileReadBuffer {
+        int fd = -1;      ///< file descriptor
+        size_t offset = 0;  ///< offset of next read
+        size_t end = 0;     ///< one past last byte to read
+    };
+    /// File region written through \c pwrite; received data is coalesced
+    /// into large writes. The file descriptor is not owned by the client.
+    struct FileWriteBuffer {
+        int fd = -1;            ///< file descriptor
+        size_t offset = 0;      ///< file offset of buffer
+        std::vector<char> data;  ///< buffer, written when full
+        size_t fill = 0;        ///< bytes in buffer
+        bool error = false;     ///< \c true if a write failed
+        /// number of received bytes to keep, all if not set
+        std::function<size_t(size_t)> accept;
+        bool stopped = false;   ///< \c true if data was not accepted
+        /// handle queried for the response code before the first write
+        CURL* curl = nullptr;
+        long status = 0;        ///< response code, zero until queried
+        /// receives the body of an error response instead of the file
+        Buffer* errorBody = nullptr;
+        /// Write buffered data, return \c false on error
+        bool Flush();
+    };
 
    public:
     /// Disable copy constructor: only one libcurl handle per thread
@@ -97,9 +148,33 @@ class WebClient {
           headers_(other.headers_),
           writeBuffer_(other.writeBuffer_),
           headerBuffer_(other.headerBuffer_),
-          curl_(other.curl_) {
+          curl_(other.curl_),
+          connectionCache_(other.connectionCache_),
+          url_(other.url_),
+          errorBuffer_(other.errorBuffer_),
+          curlHeaderList_(other.curlHeaderList_),
+          responseCode_(other.responseCode_),
+          curlCode_(other.curlCode_),
+          urlEncodedPostData_(other.urlEncodedPostData_),
+          readBuffer_(other.readBuffer_),
+          refBuffer_(other.refBuffer_),
+          fileReadBuffer_(other.fileReadBuffer_),
+          fileWriteBuffer_(std::move(other.fileWriteBuffer_)),
+          readAhead_(std::move(other.readAhead_)),
+          uringSource_(std::move(other.uringSource_)),
+          uringSink_(std::move(other.uringSink_)),
+          directSource_(std::move(other.directSource_)),
+          directSink_(std::move(other.directSink_)),
+          chunkedEncoder_(std::move(other.chunkedEncoder_)),
+          readFunction_(other.readFunction_),
+          cancelled_(other.cancelled_.load()) {
         other.curl_ = NULL;
+        other.curlHeaderList_ = NULL;
+        other.fileReadBuffer_.fd = -1;
+        Rebind(other);
     }
+    /// Move assignment, resources of the current instance are released
+    WebClient& operator=(WebClient&& other);
     /// Default constructor. First instance initializes libcurl.
     WebClient() { InitEnv(); }
     /// Constructor initializing only URL
@@ -119,7 +194,8 @@ class WebClient {
           headers_(headers) {
         InitEnv();
     }
-    /// Destructor. Last instance cleans up libcurl.
+    /// Destructor. The curl handle is reset and returned to a per-thread pool
+    /// to be reused by the next instance.
     ~WebClient();
     /// \brief Send request. 
     /// 
@@ -138,6 +214,10 @@ class WebClient {
     void SetPath(const std::string& path);
     /// Store headers into internall buffer.
     void SetHeaders(const Map& headers);
+    /// Append header to the request without storing it into the internal
+    /// buffer; such headers are dropped by the next call to SetHeaders() and
+    /// are not signed by SetUploadChunked().
+    void AddHeader(std::string_view name, std::string_view value);
     /// Storerequest parameters into internal buffer.
     void SetReqParameters(const Map& params);
     /// Set HTTP method.
@@ -151,6 +231,18 @@ class WebClient {
     void SetPostData(const std::string& data);
     /// Return status code from last executed request.
     long StatusCode() const;
+    /// Return libcurl result code from last executed request.
+    CURLcode CurlCode() const;
+    /// Return duration of last executed request in seconds.
+    double TransferTime() const;
+    /// \brief Cancel transfer in progress.
+    ///
+    /// Can be invoked from any thread, the transfer fails with
+    /// \c CURLE_ABORTED_BY_CALLBACK shortly after.
+    void Cancel() { cancelled_ = true; }
+    /// \c true if the transfer was cancelled or its result discarded in
+    /// favour of a duplicate request
+    bool Cancelled() const { return cancelled_; }
     /// Return full URL.
     const std::string& GetUrl() const;
     /// Get response content.
@@ -203,6 +295,99 @@ class WebClient {
     /// \param size data size
     /// \return \c true if successful, \c false otherwise
     bool UploadDataFromBuffer(const char* data, size_t offset, size_t size);
+    /// \brief Configure upload of file region without sending the request.
+    ///
+    /// Used to hand the request over to a TransferEngine; the file is kept
+    /// open until the client is destroyed.
+    /// \param fname file name
+    /// \param offset offset
+    /// \param size number of bytes to upload
+    /// \param readAhead if not zero the region is read in slices of this
+    /// size by background threads while the previous slice is sent
+    void SetUploadFile(const std::string& fname, size_t offset, size_t size,
+                       size_t readAhead = 0);
+    /// \brief Write received data to file region through \c pwrite.
+    ///
+    /// Data is accumulated and written in blocks of \c bufferSize bytes,
+    /// the last block when the transfer ends; a write error fails the
+    /// transfer. The file descriptor can be shared by multiple clients
+    /// writing different regions and must stay open until the transfer
+    /// ends. The body of an error response is not written to the file but
+    /// returned by GetContentText().
+    /// \param fd file descriptor
+    /// \param offset offset of region
+    /// \param bufferSize size of each write
+    /// \param accept if set, invoked with the number of bytes received
+    /// and returning how many to write; when fewer bytes are accepted the
+    /// transfer is stopped and completes successfully
+    void SetDownloadFile(int fd, size_t offset,
+                         size_t bufferSize = size_t(4) << 20,
+                         std::function<size_t(size_t)> accept = nullptr);
+    /// \brief Configure upload of file region read through \c io_uring.
+    ///
+    /// Reads of \c sliceSize bytes are queued ahead of the network into
+    /// registered buffers.
+    /// \param fname file name
+    /// \param offset offset
+    /// \param size number of bytes to upload
+    /// \param sliceSize size of each read
+    /// \param direct bypass page cache with \c O_DIRECT
+    void SetUploadFileURing(const std::string& fname, size_t offset,
+                            size_t size, size_t sliceSize, bool direct);
+    /// \brief Write received data to file region through \c io_uring.
+    ///
+    /// Data is written in slices of \c sliceSize bytes while the next slice
+    /// is received; the file is not truncated. Pending writes are completed
+    /// when the transfer ends and a write error fails the transfer.
+    /// \param fname file name
+    /// \param offset offset of region
+    /// \param sliceSize size of each write
+    /// \param direct bypass page cache with \c O_DIRECT
+    void SetDownloadFileURing(const std::string& fname, size_t offset,
+                              size_t sliceSize, bool direct);
+    /// \brief Configure upload of file region read with \c O_DIRECT.
+    ///
+    /// The region is read in slices of the buffer size; the buffer is
+    /// returned to its pool when the client is destroyed.
+    /// \param fname file name
+    /// \param offset offset
+    /// \param size number of bytes to upload
+    /// \param buffer buffer from pool
+    void SetUploadFileDirect(const std::string& fname, size_t offset,
+                             size_t size, BufferPool::Buffer buffer);
+    /// \brief Write received data to file region with \c O_DIRECT.
+    ///
+    /// Data is written each time the buffer is full, the file is not
+    /// truncated. The last write happens when the transfer ends and a write
+    /// error fails the transfer.
+    /// \param fname file name
+    /// \param offset offset of region
+    /// \param buffer buffer from pool
+    void SetDownloadFileDirect(const std::string& fname, size_t offset,
+                               BufferPool::Buffer buffer);
+    /// \brief Return buffer of completed \c O_DIRECT download, e.g. to
+    /// reuse it for a retry; empty if no such download was configured.
+    BufferPool::Buffer ReleaseDownloadBuffer();
+    /// \brief Configure upload from memory buffer without sending the request.
+    ///
+    /// \param data pointer to data, must be valid until the request completes
+    /// \param size data size
+    void SetUploadBuffer(const char* data, size_t size);
+    /// \brief Sign payload chunk by chunk and append checksum trailer
+    /// while it is sent.
+    ///
+    /// The payload configured by the last SetUpload* call is sent with
+    /// "aws-chunked" encoding through an AwsChunkedEncoder; request headers
+    /// must be the ones returned by SignStreamingHeaders.
+    /// \param chunkSize size of payload data in each chunk
+    /// \param signer signer used to sign the headers, must be valid until
+    /// the request completes; \c nullptr if chunks are not signed
+    void SetChunkedEncoding(size_t chunkSize,
+                            const SigV4Signer* signer = nullptr);
+    /// Return checksum of payload sent in trailer, \c nullptr if none
+    const Checksum* PayloadChecksum() const {
+        return chunkedEncoder_ ? chunkedEncoder_->PayloadChecksum() : nullptr;
+    }
     /// Return curl error.
     std::string ErrorMsg() const;
     /// \brief Passthrough to curl_easy_setopt
@@ -217,12 +402,23 @@ class WebClient {
     void SetVerbose(bool verbose);
     /// Redirect stderr to file. Returns \c false when it fails.
     bool RedirectSTDErr(FILE* f);
+    /// \brief Set HTTP protocol version.
+    ///
+    /// With HTTP/2 requests sent through the same TransferEngine to the same
+    /// endpoint wait for an existing connection and are multiplexed over it.
+    bool SetHTTPVersion(HTTPVersion version);
    private:
+    friend class TransferEngine;
+    friend class ConnectionCache;
    /**
      * \addtogroup internal
      * @{
      */
     bool Status(CURLcode cc) const;
+    bool Done(CURLcode cc);
+    void Release();
+    static void GlobalInit();
+    void Rebind(const WebClient& other);
     void InitEnv();
     bool Init();
     bool BuildURL();
@@ -234,9 +430,29 @@ class WebClient {
                          Buffer* inBuffer);
     static size_t MemReader(void* ptr, size_t size, size_t nmemb,
                                MemReadBuffer* inBuffer);
+    static size_t FileReader(void* ptr, size_t size, size_t nmemb,
+                             FileReadBuffer* inBuffer);
+    static int Progress(WebClient* client, curl_off_t, curl_off_t, curl_off_t,
+                        curl_off_t);
+    static size_t FileWriter(char* data, size_t size, size_t nmemb,
+                             FileWriteBuffer* outBuffer);
+    static size_t ReadAheadReader(void* ptr, size_t size, size_t nmemb,
+                                  ReadAhead* readAhead);
+    static size_t URingReader(void* ptr, size_t size, size_t nmemb,
+                              URingFileSource* source);
+    static size_t URingWriter(char* data, size_t size, size_t nmemb,
+                              URingFileSink* sink);
+    static size_t DirectReader(void* ptr, size_t size, size_t nmemb,
+                               DirectFileSource* source);
+    static size_t DirectWriter(char* data, size_t size, size_t nmemb,
+                               DirectFileSink* sink);
+    static size_t ChunkedReader(void* ptr, size_t size, size_t nmemb,
+                                AwsChunkedEncoder* encoder);
 
    private:
     CURL* curl_ = NULL;  ///< curl handle C pointer
+    /// connections, DNS and TLS sessions shared with other instances
+    std::shared_ptr<ConnectionCache> connectionCache_;
     std::string url_; ///< full url address <protocol>://<server name>:port/path
     std::array<char, CURL_ERROR_SIZE> errorBuffer_; ///< holds error message
     Buffer writeBuffer_; ///< store received response
@@ -249,17 +465,25 @@ class WebClient {
     std::string method_;    ///< GET | POST | PUT | HEAD | DELETE
     curl_slist* curlHeaderList_ = NULL;  ///< C struct --> NULL not nullptr
     long responseCode_ = 0;              ///< CURL uses a long type for status
+    CURLcode curlCode_ = CURLE_OK;       ///< result of last transfer
     std::string urlEncodedPostData_; ///< store url-encodd post data
     Buffer readBuffer_; ///< store data to send
     MemReadBuffer refBuffer_; ///< pointer to input memory region. 
+    FileReadBuffer fileReadBuffer_; ///< input file region
+    FileWriteBuffer fileWriteBuffer_; ///< output file region
+    std::unique_ptr<ReadAhead> readAhead_; ///< double-buffered file region
+    std::unique_ptr<URingFileSource> uringSource_; ///< io_uring file region
+    std::unique_ptr<URingFileSink> uringSink_;     ///< io_uring output region
+    std::unique_ptr<DirectFileSource> directSource_;  ///< O_DIRECT region
+    std::unique_ptr<DirectFileSink> directSink_;  ///< O_DIRECT output region
+    std::unique_ptr<AwsChunkedEncoder> chunkedEncoder_;  ///< chunked payload
+    ReadFunction readFunction_ = NULL;  ///< function reading data to send
+    void* writeData_ = NULL; ///< data passed to write function
+    void* readData_ = NULL;  ///< data passed to read function
+    std::atomic<bool> cancelled_{false};  ///< set by Cancel()
 /**
   * @}
   */
-   private:
-    static std::atomic<int> numInstances_; ///< track number of instances.
-    static std::mutex cleanupMutex_; ///< guarantee that initialization and
-                                     ///< cleanup happen only once.
- 
 };
 
 }  // namespace sss
@@ -0,0 +1,222 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file aws_chunked.cpp
+ * \brief implementation of AwsChunkedEncoder class
+ */
+
+#include "aws_chunked.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "sha256_fast.h"
+
+namespace sss {
+
+using namespace std;
+
+namespace {
+const char CHUNK_SIGNATURE[] = ";chunk-signature=";
+const size_t CHUNK_SIGNATURE_SIZE = sizeof(CHUNK_SIGNATURE) - 1;
+
+const char TRAILER_SIGNATURE[] = "x-amz-trailer-signature:";
+const size_t TRAILER_SIGNATURE_SIZE = sizeof(TRAILER_SIGNATURE) - 1;
+const char CHECKSUM_HEADER_PREFIX[] = "x-amz-checksum-";
+
+// Number of hex digits of chunk size
+size_t HexDigits(size_t n) {
+    size_t d = 1;
+    while (n >>= 4) ++d;
+    return d;
+}
+
+// Algorithm of "x-amz-trailer" checksum header
+ChecksumAlgorithm TrailerAlgorithm(const string& trailer) {
+    const size_t n = sizeof(CHECKSUM_HEADER_PREFIX) - 1;
+    if (trailer.compare(0, n, CHECKSUM_HEADER_PREFIX) != 0) {
+        throw invalid_argument("Unsupported trailer " + trailer);
+    }
+    return ParseChecksumAlgorithm(trailer.substr(n));
+}
+}  // namespace
+
+// public:
+size_t AwsChunkedEncoder::EncodedSize(size_t payloadSize, size_t chunkSize,
+                                      const string& payloadHash,
+                                      const string& trailer) {
+    const bool signChunks = payloadHash != STREAMING_UNSIGNED_PAYLOAD_TRAILER;
+    const size_t overhead =
+        (signChunks ? CHUNK_SIGNATURE_SIZE + SigV4Signer::SIGNATURE_SIZE : 0) +
+        4;  // two CRLF
+    const size_t full = payloadSize / chunkSize;
+    const size_t last = payloadSize % chunkSize;
+    size_t size = payloadSize + 1 + overhead;  // empty chunk
+    size += full * (HexDigits(chunkSize) + overhead);
+    if (last > 0) size += HexDigits(last) + overhead;
+    if (!trailer.empty()) {
+        // name:value CRLF
+        const Checksum checksum(TrailerAlgorithm(trailer));
+        size += trailer.size() + 1 + checksum.Base64().size() + 2;
+        if (signChunks) {
+            size += TRAILER_SIGNATURE_SIZE + SigV4Signer::SIGNATURE_SIZE + 2;
+        }
+    }
+    return size;
+}
+
+ssize_t AwsChunkedEncoder::Read(char* ptr, size_t size) {
+    if (begin_ == end_) {
+        if (last_) return 0;
+        if (!NextChunk()) return -1;
+    }
+    const size_t n = min(size, end_ - begin_);
+    memcpy(ptr, buffer_.data() + begin_, n);
+    begin_ += n;
+    return ssize_t(n);
+}
+
+// private:
+AwsChunkedEncoder::AwsChunkedEncoder(const SigV4Signer* signer,
+                                     const Map& signedHeaders,
+                                     size_t chunkSize)
+    : signer_(signer), chunkSize_(chunkSize) {
+    if (chunkSize_ < MIN_CHUNK_SIZE) {
+        throw invalid_argument("Chunk size must be at least " +
+                               to_string(MIN_CHUNK_SIZE));
+    }
+    auto header = [&signedHeaders](const string& name) {
+        auto i = signedHeaders.find(name);
+        if (i == signedHeaders.end()) {
+            throw invalid_argument("Missing header " + name);
+        }
+        return i->second;
+    };
+    payloadHash_ = header("x-amz-content-sha256");
+    const bool signChunks = payloadHash_ != STREAMING_UNSIGNED_PAYLOAD_TRAILER;
+    if (signChunks && payloadHash_ != STREAMING_PAYLOAD &&
+        payloadHash_ != STREAMING_PAYLOAD_TRAILER) {
+        throw invalid_argument("Payload not sent by chunk");
+    }
+    if (payloadHash_ != STREAMING_PAYLOAD) {
+        trailer_ = header("x-amz-trailer");
+        checksum_ = Checksum(TrailerAlgorithm(trailer_));
+    }
+    if (!signChunks) {
+        signer_ = nullptr;
+    } else if (!signer_) {
+        throw invalid_argument("Chunk signature requires signer");
+    }
+    timeStamp_ = header("x-amz-date");
+    payloadSize_ = stoull(header("x-amz-decoded-content-length"));
+    remaining_ = payloadSize_;
+    const string authorization = header("Authorization");
+    const size_t s = authorization.rfind("Signature=");
+    if (s == string::npos ||
+        authorization.size() - s - 10 != SigV4Signer::SIGNATURE_SIZE) {
+        throw invalid_argument("Invalid Authorization header");
+    }
+    memcpy(signature_, authorization.data() + s + 10, sizeof(signature_));
+    buffer_.resize(MAX_HEADER_SIZE +
+                   max(min(chunkSize_, payloadSize_) + 2, MAX_TRAILER_SIZE));
+}
+
+// Read, hash and sign next chunk; return \c false on read error
+bool AwsChunkedEncoder::NextChunk() {
+    char* data = buffer_.data() + MAX_HEADER_SIZE;
+    const size_t size = min(chunkSize_, remaining_);
+    size_t n = 0;
+    while (n < size) {
+        const size_t r = read_(data + n, 1, size - n, readData_);
+        // short source or error
+        if (r == 0 || r > size - n) return false;
+        n += r;
+    }
+    remaining_ -= size;
+    last_ = size == 0;
+    if (!trailer_.empty()) checksum_.Add(data, size);
+    char header[MAX_HEADER_SIZE];
+    size_t h = HexDigits(size);
+    for (size_t i = 0, v = size; i != h; ++i, v >>= 4) {
+        header[h - 1 - i] = "0123456789abcdef"[v & 0xF];
+    }
+    if (signer_) {
+        const string hash = Sha256Hex(data, size);
+        // previous signature is read before the new one is written
+        signer_->SignChunk(timeStamp_,
+                           string_view(signature_, sizeof(signature_)), hash,
+                           signature_);
+        memcpy(header + h, CHUNK_SIGNATURE, CHUNK_SIGNATURE_SIZE);
+        h += CHUNK_SIGNATURE_SIZE;
+        memcpy(header + h, signature_, sizeof(signature_));
+        h += sizeof(signature_);
+    }
+    memcpy(header + h, "\r\n", 2);
+    h += 2;
+    begin_ = MAX_HEADER_SIZE - h;
+    memcpy(buffer_.data() + begin_, header, h);
+    if (last_ && !trailer_.empty()) {
+        end_ = MAX_HEADER_SIZE + WriteTrailer(data);
+    } else {
+        memcpy(data + size, "\r\n", 2);
+        end_ = MAX_HEADER_SIZE + size + 2;
+    }
+    return true;
+}
+
+// Write trailing checksum header after the empty chunk, signed if chunks are
+// signed, followed by an empty line; return number of bytes written
+size_t AwsChunkedEncoder::WriteTrailer(char* out) {
+    // the signature covers the header terminated by LF
+    const string line = trailer_ + ":" + checksum_.Base64() + "\n";
+    size_t n = line.size() - 1;
+    memcpy(out, line.data(), n);
+    memcpy(out + n, "\r\n", 2);
+    n += 2;
+    if (signer_) {
+        const string hash = Sha256Hex(line.data(), line.size());
+        signer_->SignTrailer(timeStamp_,
+                             string_view(signature_, sizeof(signature_)), hash,
+                             signature_);
+        memcpy(out + n, TRAILER_SIGNATURE, TRAILER_SIGNATURE_SIZE);
+        n += TRAILER_SIGNATURE_SIZE;
+        memcpy(out + n, signature_, sizeof(signature_));
+        n += sizeof(signature_);
+        memcpy(out + n, "\r\n", 2);
+        n += 2;
+    }
+    memcpy(out + n, "\r\n", 2);
+    return n + 2;
+}
+
+}  // namespace sss
@@ -31,19 +31,21 @@
  *POSSIBILITY OF SUCH DAMAGE.
  ******************************************************************************/
 // Functions to sign S3 URL and HTTP headers
-#include <hmac.h>
-#include <sha256.h>
-
+#include <cstring>
 #include <ctime>
-#include <iomanip>
 #include <map>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "aws_sign.h"
 #include "common.h"
+#include "hmac_sha256.h"
+#include "sha256_fast.h"
+#include "signing_key_cache.h"
 #include "url_utility.h"
 using namespace std;
 
@@ -53,52 +55,11 @@ namespace sss {
 using Bytes = vector<uint8_t>;
 
 //------------------------------------------------------------------------------
-// Compute HMAC hash of data and key using MD5, SHA1 or SHA256
-// using byte arrays instead of strings
-// Code modified from
-// hmac.h
-// Copyright (c) 2015 Stephan Brumme. All rights reserved.
-// see http://create.stephan-brumme.com/disclaimer.html
-template <typename HashMethod>
+// Compute HMAC-SHA256 hash of data and key using byte arrays instead of
+// strings
 Bytes hmacb(const Bytes& d, const Bytes& k) {
-    const void* data = d.data();
-    const size_t numDataBytes = d.size();
-    const void* key = k.data();
-    const size_t numKeyBytes = k.size();
-    // initialize key with zeros
-    unsigned char usedKey[HashMethod::BlockSize] = {0};
-
-    // adjust length of key: must contain exactly blockSize bytes
-    if (numKeyBytes <= HashMethod::BlockSize) {
-        // copy key
-        memcpy(usedKey, key, numKeyBytes);
-    } else {
-        // shorten key: usedKey = hashed(key)
-        HashMethod keyHasher;
-        keyHasher.add(key, numKeyBytes);
-        keyHasher.getHash(usedKey);
-    }
-
-    // create initial XOR padding
-    for (size_t i = 0; i < HashMethod::BlockSize; i++) usedKey[i] ^= 0x36;
-
-    // inside = hash((usedKey ^ 0x36) + data)
-    unsigned char inside[HashMethod::HashBytes];
-    HashMethod insideHasher;
-    insideHasher.add(usedKey, HashMethod::BlockSize);
-    insideHasher.add(data, numDataBytes);
-    insideHasher.getHash(inside);
-
-    // undo usedKey's previous 0x36 XORing and apply a XOR by 0x5C
-    for (size_t i = 0; i < HashMethod::BlockSize; i++)
-        usedKey[i] ^= 0x5C ^ 0x36;
-
-    // hash((usedKey ^ 0x5C) + hash((usedKey ^ 0x36) + data))
-    HashMethod finalHasher;
-    finalHasher.add(usedKey, HashMethod::BlockSize);
-    finalHasher.add(inside, HashMethod::HashBytes);
-    std::vector<uint8_t> b(HashMethod::HashBytes);
-    finalHasher.getHash(b.data());
+    Bytes b(HmacSha256::HASH_SIZE);
+    HmacSha256(k.data(), k.size()).Compute(d.data(), d.size(), b.data());
     return b;
 }
 
@@ -109,8 +70,9 @@ Bytes hmacb(const Bytes& d, const Bytes& k) {
 Time GetDates() {
     time_t t;
     time(&t);
-    struct tm* ts;
-    ts = gmtime(&t);
+    // gmtime_r: requests are signed concurrently by multiple threads
+    struct tm tms;
+    const struct tm* ts = gmtime_r(&t, &tms);
 
     const size_t BUFSIZE = 128;
     vector<char> buf1(BUFSIZE, '\0');
@@ -125,7 +87,7 @@ Time GetDates() {
 //------------------------------------------------------------------------------
 // HMAC encoding byte arrays --> byte array
 Bytes Hash(const Bytes& key, const Bytes& msg) {
-    return hmacb<SHA256>(msg, key);
+    return hmacb(msg, key);
 }
 
 //------------------------------------------------------------------------------
@@ -145,14 +107,38 @@ Bytes CreateSignatureKey(const string& key, const string& dateStamp,
 }
 
 //------------------------------------------------------------------------------
-// Byte to hex string conversion
-string Hex(const Bytes& b) {
-    ostringstream os;
+// Return cached signing key, derived at most once per day for each
+// (secret, region, service)
+const SigningKey& SignatureKey(const string& key, const string& dateStamp,
+                               const string& region, const string& service) {
+    static SigningKeyCache cache(CreateSignatureKey);
+    return cache.Get(key, dateStamp, region, service);
+}
 
-    for (auto x : b) {
-        os << std::setfill('0') << std::setw(2) << std::hex << int(x);
+//------------------------------------------------------------------------------
+// Table driven byte to hex conversion, writes 2 * size characters
+void HexEncode(const uint8_t* b, size_t size, char* out) {
+    static const char* digits = "0123456789abcdef";
+    for (size_t i = 0; i != size; ++i) {
+        out[2 * i] = digits[b[i] >> 4];
+        out[2 * i + 1] = digits[b[i] & 0xf];
     }
-    return os.str();
+}
+
+//------------------------------------------------------------------------------
+// Hex encoded signature of string to sign
+string Signature(const SigningKey& key, const string& stringToSign) {
+    uint8_t signature[HmacSha256::HASH_SIZE];
+    key.hmac.Compute(stringToSign.data(), stringToSign.size(), signature);
+    string s(2 * sizeof(signature), '\0');
+    HexEncode(signature, sizeof(signature), &s[0]);
+    return s;
+}
+
+//------------------------------------------------------------------------------
+string HostHeader(const string& endpoint) {
+    const URL url = ParseURL(endpoint);
+    return url.port <= 0 ? url.host : url.host + ":" + to_string(url.port);
 }
 
 //------------------------------------------------------------------------------
@@ -161,9 +147,7 @@ string SignedURL(const string& accessKey, const string& secretKey,
                  int expiration, const string& endpoint, const string& method,
                  const string& bucketName, const string& keyName,
                  const Map& params, const string& region) {
-    const URL url = ParseURL(endpoint);
-    const string host =
-        url.port <= 0 ? url.host : url.host + ":" + to_string(url.port);
+    const string host = HostHeader(endpoint);
     Time t = GetDates();
     const string credentials =
         accessKey + "/" + t.dateStamp + "/" + region + "/s3/aws4_request";
@@ -201,17 +185,13 @@ string SignedURL(const string& accessKey, const string& secretKey,
     const string hashingAlgorithm = "AWS4-HMAC-SHA256";
     const string credentialCtx =
         t.dateStamp + "/" + region + "/" + "s3" + "/" + "aws4_request";
-    SHA256 sha256;
-    const string stringToSign = hashingAlgorithm + "\n" + t.timeStamp + "\n" +
-                                credentialCtx + "\n" +
-                                sha256(canonical_request);
+    const string stringToSign =
+        hashingAlgorithm + "\n" + t.timeStamp + "\n" + credentialCtx + "\n" +
+        Sha256Hex(canonical_request.data(), canonical_request.size());
 
     // generate the signature
-    const Bytes signatureKey =
-        CreateSignatureKey(secretKey, t.dateStamp, region, "s3");
-
-    const string signature = Hex(hmacb<SHA256>(
-        Bytes(begin(stringToSign), end(stringToSign)), signatureKey));
+    const string signature = Signature(
+        SignatureKey(secretKey, t.dateStamp, region, "s3"), stringToSign);
 
     string requestUrl = endpoint;
     if (!bucketName.empty()) {
@@ -245,9 +225,7 @@ Map SignHeaders(const string& accessKey, const string& secretKey,
     if (payloadHash.empty()) {
         payloadHash = "UNSIGNED-PAYLOAD";
     }
-    const URL url = ParseURL(endpoint);
-    const string host =
-        url.port <= 0 ? url.host : url.host + ":" + to_string(url.port);
+    const string host = HostHeader(endpoint);
     Time t = GetDates();
     const string reqParameters =
         parameters.empty() ? "" : UrlEncode(parameters);
@@ -312,16 +290,12 @@ Map SignHeaders(const string& accessKey, const string& secretKey,
     const string credentialScope =
         t.dateStamp + '/' + region + '/' + service + '/' + "aws4_request";
 
-    SHA256 sha256;
-    const string stringToSign = algorithm + '\n' + t.timeStamp + '\n' +
-                                credentialScope + '\n' +
-                                sha256(canonicalRequest);
+    const string stringToSign =
+        algorithm + '\n' + t.timeStamp + '\n' + credentialScope + '\n' +
+        Sha256Hex(canonicalRequest.data(), canonicalRequest.size());
     // generate the signature
-    const Bytes signatureKey =
-        CreateSignatureKey(secretKey, t.dateStamp, region, service);
-
-    const string signature = Hex(hmacb<SHA256>(
-        Bytes(begin(stringToSign), end(stringToSign)), signatureKey));
+    const string signature = Signature(
+        SignatureKey(secretKey, t.dateStamp, region, service), stringToSign);
 
     // build authorisaton header
     const string authorizationHeader =
@@ -333,4 +307,261 @@ Map SignHeaders(const string& accessKey, const string& secretKey,
     return allHeaders;
 }
 
-}  // namespace sss
\ No newline at end of file
+//------------------------------------------------------------------------------
+SigV4Signer::SigV4Signer(const string& accessKey, const string& secretKey,
+                         const string& region, const string& service)
+    : accessKey_(accessKey),
+      secretKey_(secretKey),
+      region_(region),
+      service_(service) {
+    // bound size of credential scope built on the stack
+    if (region.empty() || region.size() > 64 || service.empty() ||
+        service.size() > 64) {
+        throw invalid_argument("Invalid region or service name");
+    }
+}
+
+//------------------------------------------------------------------------------
+void SigV4Signer::TimeStamp(char (&ts)[TIMESTAMP_SIZE + 1]) {
+    const time_t t = time(nullptr);
+    struct tm tms;
+    strftime(ts, sizeof(ts), "%Y%m%dT%H%M%SZ", gmtime_r(&t, &tms));
+}
+
+//------------------------------------------------------------------------------
+// Canonical request:
+//   method\nURI\nquery\n(name:value\n)*\n(name;)*name\npayloadHash
+// String to sign:
+//   AWS4-HMAC-SHA256\ntimestamp\ndate/region/service/aws4_request\nhash
+void SigV4Signer::Sign(const SigV4Request& req, string& authorization) const {
+    if (req.timeStamp.size() != TIMESTAMP_SIZE) {
+        throw invalid_argument("Invalid timestamp format");
+    }
+    for (size_t i = 0; i != req.numHeaders; ++i) {
+        const string_view n = req.headers[i].name;
+        for (char c : n) {
+            if (c >= 'A' && c <= 'Z') {
+                throw invalid_argument("Header keys must be lowecase");
+            }
+        }
+        if (i > 0 && !(req.headers[i - 1].name < n)) {
+            throw invalid_argument("Headers must be sorted by name");
+        }
+    }
+    Sha256 sha256;
+    auto add = [&sha256](string_view s) { sha256.Add(s.data(), s.size()); };
+    add(req.method);
+    add("\n");
+    add(req.canonicalURI);
+    add("\n");
+    add(req.canonicalQuery);
+    add("\n");
+    for (size_t i = 0; i != req.numHeaders; ++i) {
+        add(req.headers[i].name);
+        add(":");
+        add(req.headers[i].value);
+        add("\n");
+    }
+    add("\n");
+    for (size_t i = 0; i != req.numHeaders; ++i) {
+        if (i > 0) add(";");
+        add(req.headers[i].name);
+    }
+    add("\n");
+    add(req.payloadHash);
+    uint8_t hash[Sha256::HASH_SIZE];
+    sha256.Hash(hash);
+
+    // region and service are at most 64 characters each
+    char sts[320];
+    size_t n = 0;
+    auto put = [&sts, &n](string_view s) {
+        memcpy(sts + n, s.data(), s.size());
+        n += s.size();
+    };
+    const string_view date = req.timeStamp.substr(0, 8);
+    put("AWS4-HMAC-SHA256\n");
+    put(req.timeStamp);
+    put("\n");
+    const size_t scopeBegin = n;
+    put(date);
+    put("/");
+    put(region_);
+    put("/");
+    put(service_);
+    put("/aws4_request");
+    const size_t scopeEnd = n;
+    put("\n");
+    HexEncode(hash, sizeof(hash), sts + n);
+    n += 2 * sizeof(hash);
+
+    const SigningKey& key =
+        SignatureKey(secretKey_, string(date), region_, service_);
+    uint8_t signature[HmacSha256::HASH_SIZE];
+    key.hmac.Compute(sts, n, signature);
+
+    authorization.clear();
+    authorization.append("AWS4-HMAC-SHA256 Credential=");
+    authorization.append(accessKey_);
+    authorization.append("/");
+    authorization.append(sts + scopeBegin, scopeEnd - scopeBegin);
+    authorization.append(", SignedHeaders=");
+    for (size_t i = 0; i != req.numHeaders; ++i) {
+        if (i > 0) authorization.append(";");
+        authorization.append(req.headers[i].name);
+    }
+    authorization.append(", Signature=");
+    const size_t s = authorization.size();
+    authorization.resize(s + 2 * sizeof(signature));
+    HexEncode(signature, sizeof(signature), &authorization[s]);
+}
+
+//------------------------------------------------------------------------------
+// String to sign:
+//   AWS4-HMAC-SHA256-PAYLOAD\ntimestamp\ndate/region/service/aws4_request\n
+//   previous signature\nhash of empty string\nhash of chunk
+void SigV4Signer::SignChunk(string_view timeStamp, string_view previous,
+                            string_view chunkHash, char* signature) const {
+    static constexpr string_view EMPTY_HASH =
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+    if (chunkHash.size() != 2 * Sha256::HASH_SIZE) {
+        throw invalid_argument("Invalid chunk signature input");
+    }
+    char hashes[2 * (2 * Sha256::HASH_SIZE) + 1];
+    memcpy(hashes, EMPTY_HASH.data(), EMPTY_HASH.size());
+    hashes[EMPTY_HASH.size()] = '\n';
+    memcpy(hashes + EMPTY_HASH.size() + 1, chunkHash.data(),
+           chunkHash.size());
+    SignStreaming("AWS4-HMAC-SHA256-PAYLOAD\n", timeStamp, previous,
+                  string_view(hashes, sizeof(hashes)), signature);
+}
+
+//------------------------------------------------------------------------------
+// String to sign:
+//   AWS4-HMAC-SHA256-TRAILER\ntimestamp\ndate/region/service/aws4_request\n
+//   previous signature\nhash of trailing headers
+void SigV4Signer::SignTrailer(string_view timeStamp, string_view previous,
+                              string_view trailerHash,
+                              char* signature) const {
+    if (trailerHash.size() != 2 * Sha256::HASH_SIZE) {
+        throw invalid_argument("Invalid trailer signature input");
+    }
+    SignStreaming("AWS4-HMAC-SHA256-TRAILER\n", timeStamp, previous,
+                  trailerHash, signature);
+}
+
+//------------------------------------------------------------------------------
+void SigV4Signer::SignStreaming(string_view algorithm, string_view timeStamp,
+                                string_view previous, string_view hashes,
+                                char* signature) const {
+    if (timeStamp.size() != TIMESTAMP_SIZE ||
+        previous.size() != SIGNATURE_SIZE) {
+        throw invalid_argument("Invalid chunk signature input");
+    }
+    char sts[512];
+    size_t n = 0;
+    auto put = [&sts, &n](string_view s) {
+        memcpy(sts + n, s.data(), s.size());
+        n += s.size();
+    };
+    const string_view date = timeStamp.substr(0, 8);
+    put(algorithm);
+    put(timeStamp);
+    put("\n");
+    put(date);
+    put("/");
+    put(region_);
+    put("/");
+    put(service_);
+    put("/aws4_request\n");
+    put(previous);
+    put("\n");
+    put(hashes);
+    const SigningKey& key =
+        SignatureKey(secretKey_, string(date), region_, service_);
+    uint8_t hmac[HmacSha256::HASH_SIZE];
+    key.hmac.Compute(sts, n, hmac);
+    HexEncode(hmac, sizeof(hmac), signature);
+}
+
+//------------------------------------------------------------------------------
+Map SignHeaders(const SigV4Signer& signer, const string& host,
+                const string& method, const string& canonicalURI,
+                const Map& parameters, const string& payload) {
+    const string query = parameters.empty() ? "" : UrlEncode(parameters);
+    char ts[SigV4Signer::TIMESTAMP_SIZE + 1];
+    SigV4Signer::TimeStamp(ts);
+    const string_view payloadHash =
+        payload.empty() ? string_view("UNSIGNED-PAYLOAD") : payload;
+    const HeaderSpan headers[] = {{"host", host},
+                                  {"x-amz-content-sha256", payloadHash},
+                                  {"x-amz-date", ts}};
+    const string m = ToUpper(method);
+    SigV4Request req;
+    req.method = m;
+    req.canonicalURI = canonicalURI;
+    req.canonicalQuery = query;
+    req.headers = headers;
+    req.numHeaders = 3;
+    req.payloadHash = payloadHash;
+    req.timeStamp = ts;
+    string authorization;
+    signer.Sign(req, authorization);
+    return {{"host", host},
+            {"x-amz-content-sha256", string(payloadHash)},
+            {"x-amz-date", ts},
+            {"Authorization", authorization}};
+}
+
+//------------------------------------------------------------------------------
+const char STREAMING_PAYLOAD[] = "STREAMING-AWS4-HMAC-SHA256-PAYLOAD";
+const char STREAMING_PAYLOAD_TRAILER[] =
+    "STREAMING-AWS4-HMAC-SHA256-PAYLOAD-TRAILER";
+const char STREAMING_UNSIGNED_PAYLOAD_TRAILER[] =
+    "STREAMING-UNSIGNED-PAYLOAD-TRAILER";
+
+//------------------------------------------------------------------------------
+Map SignStreamingHeaders(const SigV4Signer& signer, const string& host,
+                         const string& method, const string& canonicalURI,
+                         size_t payloadSize, const Map& parameters,
+                         const string& trailer, bool signChunks) {
+    if (!signChunks && trailer.empty()) {
+        throw invalid_argument("Unsigned chunks require a trailer");
+    }
+    const string query = parameters.empty() ? "" : UrlEncode(parameters);
+    char ts[SigV4Signer::TIMESTAMP_SIZE + 1];
+    SigV4Signer::TimeStamp(ts);
+    const string size = to_string(payloadSize);
+    const char* payloadHash = STREAMING_UNSIGNED_PAYLOAD_TRAILER;
+    if (signChunks) {
+        payloadHash =
+            trailer.empty() ? STREAMING_PAYLOAD : STREAMING_PAYLOAD_TRAILER;
+    }
+    const HeaderSpan headers[] = {{"content-encoding", "aws-chunked"},
+                                  {"host", host},
+                                  {"x-amz-content-sha256", payloadHash},
+                                  {"x-amz-date", ts},
+                                  {"x-amz-decoded-content-length", size},
+                                  {"x-amz-trailer", trailer}};
+    const string m = ToUpper(method);
+    SigV4Request req;
+    req.method = m;
+    req.canonicalURI = canonicalURI;
+    req.canonicalQuery = query;
+    req.headers = headers;
+    req.numHeaders = trailer.empty() ? 5 : 6;
+    req.payloadHash = payloadHash;
+    req.timeStamp = ts;
+    string authorization;
+    signer.Sign(req, authorization);
+    Map signedHeaders = {{"content-encoding", "aws-chunked"},
+                         {"host", host},
+                         {"x-amz-content-sha256", payloadHash},
+                         {"x-amz-date", ts},
+                         {"x-amz-decoded-content-length", size},
+                         {"Authorization", authorization}};
+    if (!trailer.empty()) signedHeaders["x-amz-trailer"] = trailer;
+    return signedHeaders;
+}
+
+}  // namespace sss
@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file buffer_pool.cpp
+ * \brief implementation of BufferPool class
+ */
+
+#include "buffer_pool.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <new>
+
+namespace sss {
+
+using namespace std;
+
+namespace {
+
+const size_t PAGE = 4096;
+const size_t HUGE_PAGE = size_t(2) << 20;
+
+size_t RoundUp(size_t n, size_t a) { return (n + a - 1) / a * a; }
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// BufferPool::Buffer
+
+BufferPool::Buffer::Buffer(Buffer&& other) noexcept
+    : pool_(other.pool_), data_(other.data_) {
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+}
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        if (data_) pool_->Release(data_);
+        pool_ = other.pool_;
+        data_ = other.data_;
+        other.pool_ = nullptr;
+        other.data_ = nullptr;
+    }
+    return *this;
+}
+BufferPool::Buffer::~Buffer() {
+    if (data_) pool_->Release(data_);
+}
+size_t BufferPool::Buffer::Size() const {
+    return pool_ ? pool_->BufferSize() : 0;
+}
+
+//------------------------------------------------------------------------------
+// BufferPool
+
+// public:
+BufferPool::BufferPool(size_t bufferSize, size_t budget, bool hugePages)
+    : bufferSize_(RoundUp(max(bufferSize, size_t(1)),
+                          hugePages ? HUGE_PAGE : PAGE)),
+      hugePages_(hugePages) {
+    maxBuffers_ = max(budget / bufferSize_, size_t(1));
+}
+BufferPool::~BufferPool() {
+    for (auto b : free_) munmap(b, bufferSize_);
+}
+BufferPool::Buffer BufferPool::Acquire() {
+    unique_lock<mutex> lock(mutex_);
+    released_.wait(lock,
+                   [this] { return !free_.empty() || allocated_ < maxBuffers_; });
+    return Take(lock);
+}
+BufferPool::Buffer BufferPool::TryAcquire() {
+    unique_lock<mutex> lock(mutex_);
+    if (free_.empty() && allocated_ >= maxBuffers_) return Buffer();
+    return Take(lock);
+}
+
+// private:
+// Reuse released buffer or allocate new one, budget already checked by
+// caller; allocation happens outside the lock
+BufferPool::Buffer BufferPool::Take(unique_lock<mutex>& lock) {
+    if (!free_.empty()) {
+        char* b = free_.back();
+        free_.pop_back();
+        return Buffer(this, b);
+    }
+    ++allocated_;
+    lock.unlock();
+    try {
+        return Buffer(this, Allocate());
+    } catch (...) {
+        lock.lock();
+        --allocated_;
+        released_.notify_one();
+        throw;
+    }
+}
+// Map anonymous memory, page aligned; when huge pages are not available
+// the kernel is asked to use transparent huge pages
+char* BufferPool::Allocate() {
+    void* p = MAP_FAILED;
+    if (hugePages_) {
+        p = mmap(nullptr, bufferSize_, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (p == MAP_FAILED) {
+        p = mmap(nullptr, bufferSize_, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw bad_alloc();
+        if (hugePages_) madvise(p, bufferSize_, MADV_HUGEPAGE);
+    }
+    return static_cast<char*>(p);
+}
+void BufferPool::Release(char* data) {
+    {
+        const lock_guard<mutex> lock(mutex_);
+        free_.push_back(data);
+    }
+    released_.notify_one();
+}
+
+}  // namespace sss
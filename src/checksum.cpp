@@ -0,0 +1,350 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file checksum.cpp
+ * \brief implementation of Checksum class
+ */
+
+#include "checksum.h"
+
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SSS_CRC_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace sss {
+
+using namespace std;
+
+namespace {
+// reflected polynomials
+const uint32_t CRC32C_POLY = 0x82F63B78;
+const uint64_t CRC64NVME_POLY = 0x9A6C9329AC4BC9B5ULL;
+
+// Product of polynomials modulo P, bit reflected: the most significant bit
+// is the coefficient of x^0
+template <typename T>
+T MultModP(T a, T b, T poly) {
+    T p = 0;
+    for (T m = T(1) << (8 * sizeof(T) - 1); m != 0; m >>= 1) {
+        if (a & m) p ^= b;
+        b = b & 1 ? (b >> 1) ^ poly : b >> 1;
+    }
+    return p;
+}
+
+// x^n modulo P, by repeated squaring
+template <typename T>
+T XPowN(uint64_t n, T poly) {
+    T p = T(1) << (8 * sizeof(T) - 1);  // x^0
+    T x2k = p >> 1;                     // x^1
+    for (; n != 0; n >>= 1) {
+        if (n & 1) p = MultModP(x2k, p, poly);
+        x2k = MultModP(x2k, x2k, poly);
+    }
+    return p;
+}
+
+// x^(8n) modulo P: shift of checksum past n bytes
+template <typename T>
+T XPow8N(uint64_t n, T poly) {
+    return XPowN(8 * n, poly);
+}
+
+// Tables for slicing-by-8: table[k][b] is the CRC of byte b followed by k
+// zero bytes
+template <typename T>
+struct Tables {
+    T table[8][256];
+    explicit Tables(T poly) {
+        for (unsigned i = 0; i != 256; ++i) {
+            T c = i;
+            for (int k = 0; k != 8; ++k) c = c & 1 ? (c >> 1) ^ poly : c >> 1;
+            table[0][i] = c;
+        }
+        for (int k = 1; k != 8; ++k) {
+            for (unsigned i = 0; i != 256; ++i) {
+                const T c = table[k - 1][i];
+                table[k][i] = (c >> 8) ^ table[0][c & 0xFF];
+            }
+        }
+    }
+};
+
+// Update CRC register, not inverted, eight bytes at a time
+template <typename T>
+T UpdateTable(const Tables<T>& tables, T crc, const uint8_t* p, size_t size) {
+    const auto& t = tables.table;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        w ^= crc;
+        crc = t[7][w & 0xFF] ^ t[6][(w >> 8) & 0xFF] ^
+              t[5][(w >> 16) & 0xFF] ^ t[4][(w >> 24) & 0xFF] ^
+              t[3][(w >> 32) & 0xFF] ^ t[2][(w >> 40) & 0xFF] ^
+              t[1][(w >> 48) & 0xFF] ^ t[0][w >> 56];
+    }
+#endif
+    for (; size != 0; ++p, --size) crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+uint32_t Crc32cTable(uint32_t crc, const uint8_t* p, size_t size) {
+    static const Tables<uint32_t> tables(CRC32C_POLY);
+    return UpdateTable(tables, crc, p, size);
+}
+
+uint64_t Crc64NvmeTable(uint64_t crc, const uint8_t* p, size_t size) {
+    static const Tables<uint64_t> tables(CRC64NVME_POLY);
+    return UpdateTable(tables, crc, p, size);
+}
+
+#ifdef SSS_CRC_X86
+// Bytes of each of the three streams
+const size_t STREAM_SIZE = 4096;
+
+// The crc32 instruction has a latency of three cycles and a throughput of
+// one per cycle: three streams are updated at once from zero and shifted
+// into place, the CRC of A followed by B being CRC(A) x^(8|B|) + CRC(B)
+__attribute__((target("sse4.2"))) uint32_t Crc32cSSE42(uint32_t crc,
+                                                        const uint8_t* p,
+                                                        size_t size) {
+    static const uint32_t SHIFT1 = XPow8N(STREAM_SIZE, CRC32C_POLY);
+    static const uint32_t SHIFT2 = XPow8N(2 * STREAM_SIZE, CRC32C_POLY);
+    for (; size >= 3 * STREAM_SIZE;
+         p += 3 * STREAM_SIZE, size -= 3 * STREAM_SIZE) {
+        uint64_t c0 = crc, c1 = 0, c2 = 0;
+        for (size_t i = 0; i != STREAM_SIZE; i += 8) {
+            uint64_t w0, w1, w2;
+            memcpy(&w0, p + i, 8);
+            memcpy(&w1, p + STREAM_SIZE + i, 8);
+            memcpy(&w2, p + 2 * STREAM_SIZE + i, 8);
+            c0 = _mm_crc32_u64(c0, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+        }
+        crc = MultModP(SHIFT2, uint32_t(c0), CRC32C_POLY) ^
+              MultModP(SHIFT1, uint32_t(c1), CRC32C_POLY) ^ uint32_t(c2);
+    }
+    uint64_t c = crc;
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c = _mm_crc32_u64(c, w);
+    }
+    crc = uint32_t(c);
+    for (; size != 0; ++p, --size) crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+
+// Carry-less multiplication of the two halves of a by the constants in k,
+// added to b
+#define SSS_CRC_FOLD(a, k, b)                                    \
+    _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x00), \
+                                _mm_clmulepi64_si128(a, k, 0x11)), \
+                  b)
+
+// Folding: a 16 byte block A = H x^64 + L followed by D bits adds to the
+// block D bits ahead H x^(D+64) + L x^D, two 64x64 bit carry-less
+// products; the bit reflected products are shifted by one bit, which is
+// compensated by one less power of x in the constants. Four blocks are
+// folded at once to hide the latency of pclmulqdq, the last 16 bytes are
+// reduced with the tables.
+__attribute__((target("pclmul,sse4.1"))) uint64_t Crc64NvmePCLMUL(
+    uint64_t crc, const uint8_t* p, size_t size) {
+    if (size < 64) return Crc64NvmeTable(crc, p, size);
+    static const uint64_t K511 = XPowN(511, CRC64NVME_POLY);
+    static const uint64_t K575 = XPowN(575, CRC64NVME_POLY);
+    static const uint64_t K127 = XPowN(127, CRC64NVME_POLY);
+    static const uint64_t K191 = XPowN(191, CRC64NVME_POLY);
+    const __m128i k512 = _mm_set_epi64x(int64_t(K511), int64_t(K575));
+    const __m128i k128 = _mm_set_epi64x(int64_t(K127), int64_t(K191));
+    auto load = [](const uint8_t* q) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(q));
+    };
+    __m128i x0 = _mm_xor_si128(load(p), _mm_cvtsi64_si128(int64_t(crc)));
+    __m128i x1 = load(p + 16);
+    __m128i x2 = load(p + 32);
+    __m128i x3 = load(p + 48);
+    for (p += 64, size -= 64; size >= 64; p += 64, size -= 64) {
+        x0 = SSS_CRC_FOLD(x0, k512, load(p));
+        x1 = SSS_CRC_FOLD(x1, k512, load(p + 16));
+        x2 = SSS_CRC_FOLD(x2, k512, load(p + 32));
+        x3 = SSS_CRC_FOLD(x3, k512, load(p + 48));
+    }
+    x1 = SSS_CRC_FOLD(x0, k128, x1);
+    x2 = SSS_CRC_FOLD(x1, k128, x2);
+    x3 = SSS_CRC_FOLD(x2, k128, x3);
+    for (; size >= 16; p += 16, size -= 16) {
+        x3 = SSS_CRC_FOLD(x3, k128, load(p));
+    }
+    uint8_t last[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(last), x3);
+    return Crc64NvmeTable(Crc64NvmeTable(0, last, 16), p, size);
+}
+
+#undef SSS_CRC_FOLD
+
+bool HasSSE42() {
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+}
+
+bool HasPCLMUL() {
+    unsigned eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL) &&
+           (ecx & bit_SSE4_1);
+}
+#endif
+
+using Update32 = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+Update32 SelectCrc32c() {
+#ifdef SSS_CRC_X86
+    if (HasSSE42()) return Crc32cSSE42;
+#endif
+    return Crc32cTable;
+}
+
+Update32 GetCrc32c() {
+    static const Update32 update = SelectCrc32c();
+    return update;
+}
+
+using Update64 = uint64_t (*)(uint64_t, const uint8_t*, size_t);
+
+Update64 SelectCrc64Nvme() {
+#ifdef SSS_CRC_X86
+    if (HasPCLMUL()) return Crc64NvmePCLMUL;
+#endif
+    return Crc64NvmeTable;
+}
+
+Update64 GetCrc64Nvme() {
+    static const Update64 update = SelectCrc64Nvme();
+    return update;
+}
+
+const char BASE64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+}  // namespace
+
+//------------------------------------------------------------------------------
+void Checksum::Add(const void* data, size_t size) {
+    if (size == 0) return;
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    if (algorithm_ == ChecksumAlgorithm::CRC32C) {
+        crc_ = ~GetCrc32c()(~uint32_t(crc_), p, size) & 0xFFFFFFFF;
+    } else {
+        crc_ = ~GetCrc64Nvme()(~crc_, p, size);
+    }
+    size_ += size;
+}
+
+//------------------------------------------------------------------------------
+// Pre and post inversion cancel out: combined = crc x^(8 size) + next
+void Checksum::Combine(const Checksum& next) {
+    if (next.algorithm_ != algorithm_) {
+        throw invalid_argument("Cannot combine checksums of different types");
+    }
+    if (algorithm_ == ChecksumAlgorithm::CRC32C) {
+        crc_ = MultModP(XPow8N(next.size_, CRC32C_POLY), uint32_t(crc_),
+                        CRC32C_POLY) ^
+               next.crc_;
+    } else {
+        crc_ = MultModP(XPow8N(next.size_, CRC64NVME_POLY), crc_,
+                        CRC64NVME_POLY) ^
+               next.crc_;
+    }
+    size_ += next.size_;
+}
+
+//------------------------------------------------------------------------------
+string Checksum::Base64() const {
+    const size_t n = algorithm_ == ChecksumAlgorithm::CRC32C ? 4 : 8;
+    uint8_t b[9] = {0};
+    for (size_t i = 0; i != n; ++i) b[i] = uint8_t(crc_ >> (8 * (n - 1 - i)));
+    string s;
+    for (size_t i = 0; i < n; i += 3) {
+        const uint32_t v = b[i] << 16 | b[i + 1] << 8 | b[i + 2];
+        s += BASE64[v >> 18];
+        s += BASE64[(v >> 12) & 0x3F];
+        s += i + 1 < n ? BASE64[(v >> 6) & 0x3F] : '=';
+        s += i + 2 < n ? BASE64[v & 0x3F] : '=';
+    }
+    return s;
+}
+
+//------------------------------------------------------------------------------
+const char* Checksum::Backend(ChecksumAlgorithm algorithm) {
+#ifdef SSS_CRC_X86
+    if (algorithm == ChecksumAlgorithm::CRC32C &&
+        GetCrc32c() == Crc32cSSE42) {
+        return "sse4.2";
+    }
+    if (algorithm == ChecksumAlgorithm::CRC64NVME &&
+        GetCrc64Nvme() == Crc64NvmePCLMUL) {
+        return "pclmul";
+    }
+#endif
+    return "table";
+}
+
+//------------------------------------------------------------------------------
+const char* ChecksumName(ChecksumAlgorithm algorithm) {
+    return algorithm == ChecksumAlgorithm::CRC32C ? "CRC32C" : "CRC64NVME";
+}
+
+//------------------------------------------------------------------------------
+string ChecksumHeader(ChecksumAlgorithm algorithm) {
+    return algorithm == ChecksumAlgorithm::CRC32C ? "x-amz-checksum-crc32c"
+                                                  : "x-amz-checksum-crc64nvme";
+}
+
+//------------------------------------------------------------------------------
+ChecksumAlgorithm ParseChecksumAlgorithm(const string& name) {
+    string n;
+    for (char c : name) n += char(toupper(static_cast<unsigned char>(c)));
+    if (n == "CRC32C") return ChecksumAlgorithm::CRC32C;
+    if (n == "CRC64NVME") return ChecksumAlgorithm::CRC64NVME;
+    throw invalid_argument("Invalid checksum algorithm " + name +
+                           ", must be one of 'crc32c', 'crc64nvme'");
+}
+
+}  // namespace sss
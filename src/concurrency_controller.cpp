@@ -0,0 +1,118 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file concurrency_controller.cpp
+ * \brief implementation of ConcurrencyController class
+ */
+
+#include "concurrency_controller.h"
+
+#include <algorithm>
+
+namespace sss {
+
+using namespace std;
+
+// public:
+ConcurrencyController::ConcurrencyController(int maxConcurrency)
+    : maxConcurrency_(max(maxConcurrency, 1)) {}
+// Wait for window to have a free slot
+void ConcurrencyController::Acquire(const string& endpoint) {
+    unique_lock<mutex> lock(mutex_);
+    Endpoint& e = Get(endpoint);
+    released_.wait(lock, [&e]() { return e.inFlight < int(e.window); });
+    ++e.inFlight;
+}
+// Reserve slot if available
+bool ConcurrencyController::TryAcquire(const string& endpoint) {
+    const lock_guard<mutex> lock(mutex_);
+    Endpoint& e = Get(endpoint);
+    if (e.inFlight >= int(e.window)) return false;
+    ++e.inFlight;
+    return true;
+}
+// Free slot and wake up waiting threads
+void ConcurrencyController::Release(const string& endpoint) {
+    {
+        const lock_guard<mutex> lock(mutex_);
+        Endpoint& e = Get(endpoint);
+        e.inFlight = max(e.inFlight - 1, 0);
+    }
+    released_.notify_all();
+}
+// Increase window by one per round trip, i.e. 1 / window per request, or
+// by one per request during slow start; halve window on throttling
+void ConcurrencyController::Update(const string& endpoint,
+                                   RequestStatus status, long httpStatus,
+                                   double seconds, size_t bytes) {
+    {
+        const lock_guard<mutex> lock(mutex_);
+        Endpoint& e = Get(endpoint);
+        const auto now = Clock::now();
+        if (status == RequestStatus::RETRY || httpStatus == 429 ||
+            httpStatus == 503) {
+            // ignore failures of requests sent before the last decrease
+            const auto rtt = chrono::duration_cast<Clock::duration>(
+                chrono::duration<double>(e.latency));
+            if (now - e.lastDecrease < rtt) return;
+            e.window = max(e.window / 2, 1.0);
+            e.slowStartThreshold = e.window;
+            e.lastDecrease = now;
+            return;
+        }
+        if (status != RequestStatus::OK || seconds <= 0) return;
+        e.latency = e.latency == 0 ? seconds : 0.8 * e.latency + 0.2 * seconds;
+        const double throughput = bytes / seconds;
+        e.bestThroughput = max(e.bestThroughput, throughput);
+        if (throughput < e.bestThroughput / 2) return;
+        const bool slowStart = e.slowStartThreshold == 0 ||
+                               e.window < e.slowStartThreshold;
+        e.window += slowStart ? 1.0 : 1.0 / e.window;
+        e.window = min(e.window, double(maxConcurrency_));
+    }
+    released_.notify_all();
+}
+// Current window
+int ConcurrencyController::Window(const string& endpoint) const {
+    const lock_guard<mutex> lock(mutex_);
+    auto i = endpoints_.find(endpoint);
+    return i == endpoints_.end() ? 1 : int(i->second.window);
+}
+
+// private:
+ConcurrencyController::Endpoint& ConcurrencyController::Get(
+    const string& endpoint) {
+    return endpoints_[endpoint];
+}
+
+}  // namespace sss
@@ -0,0 +1,85 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file connection_cache.cpp
+ * \brief implementation of ConnectionCache class, wrapper around libcurl share
+ * interface
+ */
+
+#include "connection_cache.h"
+
+#include <stdexcept>
+
+#include "webclient.h"
+
+namespace sss {
+
+using namespace std;
+
+// public:
+ConnectionCache::ConnectionCache() {
+    // libcurl must be initialized before creating the share object
+    WebClient::GlobalInit();
+    share_ = curl_share_init();
+    if (!share_) {
+        throw runtime_error("Cannot create curl share handle");
+    }
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, Lock);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, Unlock);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+// All the easy handles using the share object must have been cleaned up
+ConnectionCache::~ConnectionCache() {
+    curl_share_cleanup(share_);
+}
+// Thread local instance, created on first use
+std::shared_ptr<ConnectionCache> ConnectionCache::ForThread() {
+    thread_local shared_ptr<ConnectionCache> cache =
+        make_shared<ConnectionCache>();
+    return cache;
+}
+
+// private:
+void ConnectionCache::Lock(CURL*, curl_lock_data data, curl_lock_access,
+                           ConnectionCache* cache) {
+    cache->mutexes_[data].lock();
+}
+void ConnectionCache::Unlock(CURL*, curl_lock_data data,
+                             ConnectionCache* cache) {
+    cache->mutexes_[data].unlock();
+}
+
+}  // namespace sss
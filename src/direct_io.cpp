@@ -0,0 +1,195 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file direct_io.cpp
+ * \brief implementation of DirectFileSource and DirectFileSink classes
+ */
+
+#include "direct_io.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace sss {
+
+using namespace std;
+
+namespace {
+
+const size_t ALIGNMENT = 4096;
+
+size_t AlignUp(size_t n) { return (n + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+size_t AlignDown(size_t n) { return n & ~(ALIGNMENT - 1); }
+
+int OpenFile(const string& fname, int flags) {
+    const int fd = open(fname.c_str(), flags | O_LARGEFILE, 0644);
+    if (fd < 0) {
+        throw runtime_error("Cannot open file " + fname + ": " +
+                            strerror(errno));
+    }
+    return fd;
+}
+
+// Write whole buffer, return \c false on error
+bool PWriteFully(int fd, const char* data, size_t size, size_t offset) {
+    while (size > 0) {
+        const ssize_t r = pwrite(fd, data, size, offset);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        data += r;
+        size -= size_t(r);
+        offset += size_t(r);
+    }
+    return true;
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// DirectFileSource
+
+// public:
+DirectFileSource::DirectFileSource(const string& fname, size_t offset,
+                                   size_t size, BufferPool::Buffer buffer)
+    : buffer_(move(buffer)),
+      start_(AlignDown(offset)),
+      pos_(offset),
+      end_(offset + size) {
+    fd_ = OpenFile(fname, O_RDONLY | O_DIRECT);
+}
+DirectFileSource::~DirectFileSource() { close(fd_); }
+// Slices are read at page aligned offsets, the first one starts at the page
+// containing the region offset
+ssize_t DirectFileSource::Read(char* ptr, size_t size) {
+    if (pos_ >= end_) return 0;
+    if (pos_ >= start_ + length_) {
+        if (length_ > 0) start_ += buffer_.Size();
+        const size_t len = min(buffer_.Size(), AlignUp(end_) - start_);
+        length_ = 0;
+        while (length_ < len) {
+            // with O_DIRECT only the last read of the file can be short
+            const ssize_t r = pread(fd_, buffer_.Data() + length_,
+                                    len - length_, start_ + length_);
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0) return -1;
+            if (r == 0) break;
+            length_ += size_t(r);
+        }
+        // file shorter than region
+        if (pos_ >= start_ + length_) return -1;
+    }
+    const size_t n = min(size, min(start_ + length_, end_) - pos_);
+    memcpy(ptr, buffer_.Data() + (pos_ - start_), n);
+    pos_ += n;
+    return ssize_t(n);
+}
+
+//------------------------------------------------------------------------------
+// DirectFileSink
+
+// public:
+DirectFileSink::DirectFileSink(const string& fname, size_t offset,
+                               BufferPool::Buffer buffer)
+    : fname_(fname),
+      buffer_(move(buffer)),
+      head_(AlignUp(offset) - offset),
+      offset_(offset) {
+    fd_ = OpenFile(fname, O_WRONLY | O_CREAT | O_DIRECT);
+}
+DirectFileSink::~DirectFileSink() {
+    close(fd_);
+    if (bufferedFd_ >= 0) close(bufferedFd_);
+}
+bool DirectFileSink::Write(const char* data, size_t size) {
+    if (error_) return false;
+    if (head_ > 0) {
+        const size_t n = min(head_, size);
+        WriteBuffered(data, n, offset_);
+        head_ -= n;
+        offset_ += n;
+        data += n;
+        size -= n;
+    }
+    while (size > 0 && !error_) {
+        const size_t n = min(size, buffer_.Size() - fill_);
+        memcpy(buffer_.Data() + fill_, data, n);
+        fill_ += n;
+        data += n;
+        size -= n;
+        if (fill_ == buffer_.Size()) Flush(fill_);
+    }
+    return !error_;
+}
+// Write aligned part of the buffer directly, the rest through the page
+// cache
+bool DirectFileSink::Finish() {
+    if (finished_) return !error_;
+    finished_ = true;
+    if (fill_ > 0 && !error_) {
+        const size_t aligned = AlignDown(fill_);
+        WriteBuffered(buffer_.Data() + aligned, fill_ - aligned,
+                      offset_ + aligned);
+        if (aligned > 0) Flush(aligned);
+    }
+    return !error_;
+}
+// Buffered data is written first, Write() fails once the buffer is gone
+BufferPool::Buffer DirectFileSink::Release() {
+    Finish();
+    error_ = true;
+    return move(buffer_);
+}
+
+// private:
+void DirectFileSink::Flush(size_t size) {
+    if (!PWriteFully(fd_, buffer_.Data(), size, offset_)) error_ = true;
+    offset_ += size;
+    fill_ = 0;
+}
+void DirectFileSink::WriteBuffered(const char* data, size_t size,
+                                   size_t offset) {
+    if (size == 0) return;
+    if (bufferedFd_ < 0) {
+        bufferedFd_ = open(fname_.c_str(), O_WRONLY | O_LARGEFILE);
+    }
+    if (bufferedFd_ < 0 || !PWriteFully(bufferedFd_, data, size, offset)) {
+        error_ = true;
+    }
+}
+
+}  // namespace sss
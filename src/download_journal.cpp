@@ -0,0 +1,178 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file download_journal.cpp
+ * \brief implementation of DownloadJournal class
+ */
+
+#include "download_journal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace sss {
+
+using namespace std;
+
+// public:
+DownloadJournal::DownloadJournal(const string& path) : path_(path) {
+    const size_t size = Read();
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw runtime_error("Cannot open journal file " + path_ + ": " +
+                            strerror(errno));
+    }
+    // drop incomplete record so that the next one starts on a new line
+    if (ftruncate(fd_, off_t(size)) != 0) {
+        throw runtime_error("Cannot truncate journal file " + path_ + ": " +
+                            strerror(errno));
+    }
+}
+DownloadJournal::~DownloadJournal() {
+    if (fd_ >= 0) close(fd_);
+}
+// Complement of recorded ranges within [0, object size)
+vector<DownloadJournal::Range> DownloadJournal::Missing() const {
+    vector<Range> missing;
+    size_t pos = 0;
+    for (const auto& r : ranges_) {
+        if (r.first > pos) missing.push_back({pos, r.first});
+        pos = max(pos, r.second);
+    }
+    if (pos < objectSize_) missing.push_back({pos, objectSize_});
+    return missing;
+}
+// Record download
+void DownloadJournal::Begin(const string& bucket, const string& key,
+                            size_t objectSize, const string& etag,
+                            const string& lastModified) {
+    if (HasDownload()) {
+        throw logic_error("Journal " + path_ +
+                          " already contains a download");
+    }
+    if (etag.empty()) throw invalid_argument("Empty etag");
+    bucket_ = bucket;
+    key_ = key;
+    objectSize_ = objectSize;
+    etag_ = etag;
+    lastModified_ = lastModified;
+    // key is last since it can contain spaces
+    Append("download " + to_string(objectSize) + " " + etag + " " + bucket +
+           " " + key);
+    Append("modified " + lastModified);
+}
+// Record range
+void DownloadJournal::AddRange(size_t begin, size_t end) {
+    if (begin >= end) return;
+    const lock_guard<mutex> lock(mutex_);
+    Merge(begin, end);
+    Append("range " + to_string(begin) + " " + to_string(end));
+}
+// Delete journal file
+void DownloadJournal::Remove() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+    unlink(path_.c_str());
+}
+
+// private:
+// Read records from existing file; lines not terminated by a newline are the
+// result of an interrupted write and are discarded; returns the size of the
+// valid records
+size_t DownloadJournal::Read() {
+    ifstream in(path_);
+    if (!in) return 0;
+    const string content((istreambuf_iterator<char>(in)),
+                         istreambuf_iterator<char>());
+    const size_t size = content.rfind('\n') + 1;
+    istringstream is(content.substr(0, size));
+    string line;
+    while (getline(is, line)) {
+        istringstream ls(line);
+        string type;
+        ls >> type;
+        if (type == "download") {
+            ls >> objectSize_ >> etag_ >> bucket_;
+            ls.get();
+            getline(ls, key_);
+        } else if (type == "modified") {
+            // empty when the server returned no Last-Modified header
+            ls.get();
+            if (ls.peek() != char_traits<char>::eof()) {
+                getline(ls, lastModified_);
+            }
+        } else if (type == "range") {
+            size_t begin = 0;
+            size_t end = 0;
+            ls >> begin >> end;
+            if (begin < end) Merge(begin, end);
+        }
+        if (ls.fail()) {
+            throw runtime_error("Invalid record in journal " + path_ + ": " +
+                                line);
+        }
+    }
+    return size;
+}
+// Insert range merging it with overlapping and adjacent ranges
+void DownloadJournal::Merge(size_t begin, size_t end) {
+    auto i = ranges_.upper_bound(begin);
+    if (i != ranges_.begin() && prev(i)->second >= begin) {
+        --i;
+        begin = i->first;
+        end = max(end, i->second);
+        i = ranges_.erase(i);
+    }
+    while (i != ranges_.end() && i->first <= end) {
+        end = max(end, i->second);
+        i = ranges_.erase(i);
+    }
+    ranges_[begin] = end;
+}
+// Append record and flush to disk
+void DownloadJournal::Append(const string& record) {
+    const string line = record + "\n";
+    if (write(fd_, line.data(), line.size()) != ssize_t(line.size()) ||
+        fdatasync(fd_) != 0) {
+        throw runtime_error("Cannot write to journal file " + path_ + ": " +
+                            strerror(errno));
+    }
+}
+
+}  // namespace sss
@@ -0,0 +1,135 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file endpoint_selector.cpp
+ * \brief implementation of EndpointSelector class
+ */
+
+#include "endpoint_selector.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace sss {
+
+using namespace std;
+
+// public:
+EndpointSelector::EndpointSelector(const vector<string>& endpoints,
+                                   chrono::seconds cooldown, int maxFailures)
+    : cooldown_(cooldown), maxFailures_(max(maxFailures, 1)) {
+    if (endpoints.empty()) {
+        throw invalid_argument("Error, no endpoints specified");
+    }
+    for (const auto& e : endpoints) {
+        State s;
+        s.url = e;
+        endpoints_.push_back(s);
+    }
+}
+size_t EndpointSelector::Select() const {
+    const lock_guard<mutex> lock(mutex_);
+    return SelectLocked();
+}
+size_t EndpointSelector::Select(size_t exclude) const {
+    const lock_guard<mutex> lock(mutex_);
+    const size_t i = SelectLocked(exclude);
+    return i < endpoints_.size() ? i : exclude;
+}
+void EndpointSelector::Begin(size_t i) {
+    const lock_guard<mutex> lock(mutex_);
+    ++endpoints_[i].inFlight;
+}
+size_t EndpointSelector::Acquire() {
+    const lock_guard<mutex> lock(mutex_);
+    const size_t i = SelectLocked();
+    ++endpoints_[i].inFlight;
+    return i;
+}
+// Update latency and error rate, take endpoint out of rotation after
+// too many consecutive failures
+void EndpointSelector::End(size_t i, RequestStatus status, double seconds) {
+    const lock_guard<mutex> lock(mutex_);
+    State& s = endpoints_[i];
+    s.inFlight = max(s.inFlight - 1, 0);
+    const bool failed = status == RequestStatus::RETRY;
+    s.errorRate = 0.8 * s.errorRate + (failed ? 0.2 : 0);
+    if (!failed) {
+        s.failures = 0;
+        if (status == RequestStatus::OK && seconds > 0) {
+            s.latency =
+                s.latency == 0 ? seconds : 0.8 * s.latency + 0.2 * seconds;
+        }
+        return;
+    }
+    if (++s.failures >= maxFailures_) {
+        s.failures = 0;
+        s.downUntil = Clock::now() + cooldown_;
+    }
+}
+
+// private:
+// Endpoints without latency samples are assigned the average latency of
+// the others so that they are tried without taking all the requests;
+// with an excluded endpoint the size is returned if there is no other
+// healthy endpoint
+size_t EndpointSelector::SelectLocked(size_t exclude) const {
+    double total = 0;
+    int n = 0;
+    for (const auto& s : endpoints_) {
+        if (s.latency > 0) {
+            total += s.latency;
+            ++n;
+        }
+    }
+    const double defaultLatency = n > 0 ? total / n : 1.0;
+    const auto now = Clock::now();
+    size_t best = endpoints_.size();
+    double bestScore = 0;
+    size_t firstUp = 0;  // endpoint back in rotation first
+    for (size_t i = 0; i != endpoints_.size(); ++i) {
+        const State& s = endpoints_[i];
+        if (s.downUntil < endpoints_[firstUp].downUntil) firstUp = i;
+        if (s.downUntil > now || i == exclude) continue;
+        const double latency = s.latency > 0 ? s.latency : defaultLatency;
+        const double score = (s.inFlight + 1) * latency * (1 + s.errorRate);
+        if (best == endpoints_.size() || score < bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    if (best == endpoints_.size() && exclude == SIZE_MAX) return firstUp;
+    return best;
+}
+
+}  // namespace sss
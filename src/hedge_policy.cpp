@@ -0,0 +1,151 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file hedge_policy.cpp
+ * \brief implementation of LatencyTracker and HedgePolicy classes and of
+ * hedged send function
+ */
+
+#include "hedge_policy.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "transfer_engine.h"
+
+namespace sss {
+
+using namespace std;
+
+//------------------------------------------------------------------------------
+// LatencyTracker
+
+LatencyTracker::LatencyTracker(size_t window) : window_(max(window, size_t(1))) {
+    samples_.reserve(window_);
+}
+void LatencyTracker::Add(double seconds, size_t bytes) {
+    const double s = seconds / double(max(bytes, size_t(1)));
+    if (samples_.size() < window_) {
+        samples_.push_back(s);
+    } else {
+        samples_[next_] = s;
+    }
+    next_ = (next_ + 1) % window_;
+}
+double LatencyTracker::Quantile(double q) const {
+    if (samples_.empty()) return 0;
+    vector<double> s(samples_);
+    const size_t k =
+        min(size_t(q * double(s.size())), s.size() - 1);
+    nth_element(begin(s), begin(s) + k, end(s));
+    return s[k];
+}
+
+//------------------------------------------------------------------------------
+// HedgePolicy
+
+HedgePolicy::HedgePolicy(double budget, double quantile, size_t minSamples)
+    : budget_(budget), quantile_(quantile), minSamples_(minSamples) {}
+void HedgePolicy::Started() {
+    const lock_guard<mutex> lock(mutex_);
+    ++requests_;
+}
+void HedgePolicy::Completed(double seconds, size_t bytes) {
+    const lock_guard<mutex> lock(mutex_);
+    latency_.Add(seconds, bytes);
+}
+double HedgePolicy::Delay(size_t bytes) const {
+    const lock_guard<mutex> lock(mutex_);
+    if (latency_.Size() < max(minSamples_, size_t(1))) return -1;
+    return latency_.Quantile(quantile_) * double(max(bytes, size_t(1)));
+}
+bool HedgePolicy::CanHedge() const {
+    const lock_guard<mutex> lock(mutex_);
+    return double(hedges_ + 1) <= budget_ * double(requests_);
+}
+void HedgePolicy::Hedged() {
+    const lock_guard<mutex> lock(mutex_);
+    ++hedges_;
+}
+size_t HedgePolicy::Hedges() const {
+    const lock_guard<mutex> lock(mutex_);
+    return hedges_;
+}
+
+//------------------------------------------------------------------------------
+// The request and its duplicate are driven by a transfer engine owned by the
+// calling thread: the duplicate reuses the handles, connections and io_uring
+// of the thread, and no thread is created per request. The engine cancels
+// the slower transfer, whose completion runs before the one of the winner
+bool SendHedged(HedgePolicy& policy, size_t bytes, WebClient& req,
+                const function<unique_ptr<WebClient>()>& hedge,
+                const function<void(WebClient&)>& done) {
+    thread_local unique_ptr<TransferEngine> engine;
+    if (!engine) engine.reset(new TransferEngine(2));
+    engine->SetHedgePolicy(&policy);
+    bool ok = false;
+    // the request is moved back into req, then replaced by the duplicate if
+    // the duplicate succeeds: a losing twin completes before the winner
+    unique_ptr<WebClient> r(new WebClient(move(req)));
+    try {
+        engine->AddHedged(
+            move(r),
+            [&](WebClient& c, bool success) {
+                done(c);
+                req = move(c);
+                ok = success;
+            },
+            bytes,
+            [&](TransferEngine::Completion& d) {
+                unique_ptr<WebClient> h = hedge();
+                if (h) {
+                    d = [&](WebClient& c, bool success) {
+                        done(c);
+                        if (success) {
+                            req = move(c);
+                            ok = true;
+                        }
+                    };
+                }
+                return h;
+            });
+        engine->Run(nullptr);
+    } catch (...) {
+        // transfers left in flight are released with the engine
+        engine.reset();
+        throw;
+    }
+    return ok;
+}
+
+}  // namespace sss
@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file hmac_sha256.cpp
+ * \brief implementation of HmacSha256 class
+ */
+
+#include "hmac_sha256.h"
+
+#include <cstring>
+
+using namespace std;
+
+namespace sss {
+
+//------------------------------------------------------------------------------
+HmacSha256::HmacSha256(const uint8_t* key, size_t size) {
+    uint8_t k[Sha256::BLOCK_BYTES] = {0};
+    if (size <= Sha256::BLOCK_BYTES) {
+        memcpy(k, key, size);
+    } else {
+        Sha256 h;
+        h.Add(key, size);
+        h.Hash(k);
+    }
+    for (size_t i = 0; i != Sha256::BLOCK_BYTES; ++i) k[i] ^= 0x36;
+    inner_.Add(k, Sha256::BLOCK_BYTES);
+    for (size_t i = 0; i != Sha256::BLOCK_BYTES; ++i) k[i] ^= 0x5C ^ 0x36;
+    outer_.Add(k, Sha256::BLOCK_BYTES);
+}
+
+//------------------------------------------------------------------------------
+void HmacSha256::Compute(const void* data, size_t size, uint8_t* out) const {
+    // copies of the saved states
+    Sha256 inner = inner_;
+    inner.Add(data, size);
+    uint8_t h[HASH_SIZE];
+    inner.Hash(h);
+    Sha256 outer = outer_;
+    outer.Add(h, HASH_SIZE);
+    outer.Hash(out);
+}
+
+}  // namespace sss
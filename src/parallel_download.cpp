@@ -35,7 +35,11 @@
 // Parallel file download from S3 servers
 
 #include <aws_sign.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <cerrno>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <future>
@@ -43,10 +47,19 @@
 #include <numeric>
 #include <regex>
 #include <set>
+#include <thread>
 #include <vector>
 
+#include "buffer_pool.h"
+#include "concurrency_controller.h"
+#include "download_journal.h"
+#include "hedge_policy.h"
 #include "lyra/lyra.hpp"
+#include "range_scheduler.h"
+#include "reorder_buffer.h"
 #include "response_parser.h"
+#include "retry_policy.h"
+#include "transfer_engine.h"
 #include "webclient.h"
 #include "common.h"
 
@@ -65,6 +78,29 @@ struct Args {
     string key;
     string file;
     int jobs = 1;
+    int eventLoops = 0;
+    string http;
+    HTTPVersion httpVersion = HTTPVersion::DEFAULT;
+    long maxStreams = 0;
+    bool adaptive = false;
+    bool ioURing = false;
+    bool direct = false;
+    string bufferMemory;
+    bool hugePages = false;
+    shared_ptr<BufferPool> bufferPool;
+    int fd = -1;  // output file shared by all parts
+    string rangeSize;
+    double hedgeBudget = 0;
+    shared_ptr<HedgePolicy> hedge;
+    bool toStdout = false;  // also selected with "-f -"
+    string journalPath;
+    shared_ptr<DownloadJournal> journal;  // ranges written to output file
+    string etag;  // sent as If-Match, so that a changed object is detected
+    shared_ptr<SigV4Signer> signer;  // signs range requests
+    string host;                     // "host" header of endpoint
+    int maxRetries = 2;
+    int retryDelay = 100;
+    RetryPolicy retryPolicy;  // range requests failing transiently
 };
 
 void Validate(const Args& args) {
@@ -73,6 +109,45 @@ void Validate(const Args& args) {
         throw invalid_argument(
             "ERROR: both access and secret keys have to be specified");
     }
+    if (args.jobs < 1) {
+        throw invalid_argument(
+            "ERROR: number of jobs must be at least one, " +
+            to_string(args.jobs) + " provided");
+    }
+    if (args.eventLoops < 0 || args.eventLoops > args.jobs) {
+        throw invalid_argument(
+            "ERROR: number of event loops must be in range [0, jobs], " +
+            to_string(args.eventLoops) + " provided");
+    }
+    if (args.maxRetries < 0) {
+        throw invalid_argument(
+            "ERROR: number of retries must not be negative, " +
+            to_string(args.maxRetries) + " provided");
+    }
+    if (args.retryDelay < 0) {
+        throw invalid_argument(
+            "ERROR: retry delay must not be negative, " +
+            to_string(args.retryDelay) + " provided");
+    }
+    if (args.hedgeBudget < 0 || args.hedgeBudget > 1) {
+        throw invalid_argument(
+            "ERROR: hedge budget must be in range [0, 1], " +
+            to_string(args.hedgeBudget) + " provided");
+    }
+    if (args.hedgeBudget > 0 && (args.ioURing || args.direct)) {
+        throw invalid_argument(
+            "ERROR: --hedge not supported with --io-uring or --direct");
+    }
+    if (args.file.empty() && !args.toStdout) {
+        throw invalid_argument("ERROR: no output file specified");
+    }
+    if ((args.toStdout || args.file == "-") &&
+        (args.ioURing || args.direct || args.hedgeBudget > 0 ||
+         !args.journalPath.empty())) {
+        throw invalid_argument(
+            "ERROR: --io-uring, --direct, --hedge and --resume not supported "
+            "when writing to standard output");
+    }
 #ifdef VALIDATE_URL
     const URL url = ParseURL(args.endpoint);
     if (url.proto != "http" && url.proto != "https") {
@@ -95,36 +170,473 @@ void Validate(const Args& args) {
 using Headers = Map;
 using Parameters = Map;
 
-size_t ObjectSize(const Args& args, const string& path) {
+// Object metadata returned by HEAD request
+struct ObjectInfo {
+    size_t size = 0;
+    string etag;
+    string lastModified;
+};
+
+ObjectInfo HeadObject(const Args& args, const string& path) {
     auto signedHeaders =
         SignHeaders(args.s3AccessKey, args.s3SecretKey, args.endpoint, "HEAD",
                     args.bucket, args.key);
     Headers headers(begin(signedHeaders), end(signedHeaders));
     WebClient req(args.endpoint, path, "HEAD", {}, headers);
-    req.Send();
+    req.SetHTTPVersion(args.httpVersion);
+    if (!req.Send()) {
+        throw runtime_error("Error sending request: " + req.ErrorMsg());
+    }
+    if (req.StatusCode() >= 400) {
+        throw runtime_error("Error retrieving object size - HTTP status " +
+                            to_string(req.StatusCode()));
+    }
     const vector<uint8_t> h = req.GetResponseHeader();
     const string hs(begin(h), end(h));
     const string cl = HTTPHeader(hs, "[Cc]ontent-[Ll]ength");
     char* ns;
-    return size_t(strtoull(cl.c_str(), &ns, 10));
+    ObjectInfo info;
+    info.size = size_t(strtoull(cl.c_str(), &ns, 10));
+    info.etag = HTTPHeader(hs, "[Ee][Tt]ag");
+    // HTTPHeader() only returns the first word, the date contains spaces
+    const regex rx("[Ll]ast-[Mm]odified\\s*:\\s*([^\\r\\n]+)");
+    smatch sm;
+    if (regex_search(hs, sm, rx)) info.lastModified = sm[1];
+    return info;
 }
 
-int DownloadPart(const Args& args, const string& path, int id, size_t chunkSize,
-                 size_t lastChunkSize) {
-    auto signedHeaders =
-        SignHeaders(args.s3AccessKey, args.s3SecretKey, args.endpoint, "GET",
-                    args.bucket, args.key);
-    Headers headers(begin(signedHeaders), end(signedHeaders));
-    const size_t sz = id < args.jobs - 1 ? chunkSize : lastChunkSize;
-    const string range = "bytes=" + to_string(id * chunkSize) + "-" +
-                         to_string(id * chunkSize + sz - 1);
-    headers.insert({"Range", range});
-    WebClient req(args.endpoint, path, "GET", {}, headers);
-    FILE* out = fopen(args.file.c_str(), "wb");
-    fseek(out, id * chunkSize, SEEK_SET);
-    req.SetWriteFunction(NULL, out);
-    req.Send();
-    return req.StatusCode();
+// Signed headers are passed to the client as views of per-thread buffers,
+// with no header map built for each range
+WebClient BuildDownloadRequest(const Args& args, const string& path,
+                               const RangeScheduler::Range& range) {
+    thread_local string authorization;
+    char ts[SigV4Signer::TIMESTAMP_SIZE + 1];
+    SigV4Signer::TimeStamp(ts);
+    const HeaderSpan headers[] = {{"host", args.host},
+                                  {"x-amz-content-sha256", "UNSIGNED-PAYLOAD"},
+                                  {"x-amz-date", ts}};
+    SigV4Request sr;
+    sr.method = "GET";
+    sr.canonicalURI = path;
+    sr.headers = headers;
+    sr.numHeaders = std::size(headers);
+    sr.timeStamp = ts;
+    args.signer->Sign(sr, authorization);
+    char bytes[64];
+    snprintf(bytes, sizeof(bytes), "bytes=%zu-%zu", range.begin,
+             range.end - 1);
+    WebClient req(args.endpoint, path, "GET");
+    for (const HeaderSpan& h : headers) req.AddHeader(h.name, h.value);
+    req.AddHeader("Authorization", authorization);
+    req.AddHeader("Range", bytes);
+    if (!args.etag.empty()) req.AddHeader("If-Match", args.etag);
+    req.SetHTTPVersion(args.httpVersion);
+    return req;
+}
+
+// Update concurrency window with outcome of request
+void UpdateConcurrency(ConcurrencyController* concurrency, const Args& args,
+                       const WebClient& req, size_t bytes) {
+    if (!concurrency) return;
+    concurrency->Update(args.endpoint, RetryPolicy::Classify(req),
+                        req.StatusCode(), req.TransferTime(), bytes);
+}
+
+// Write received data through io_uring, O_DIRECT buffers or pwrite on the
+// shared output file; the pool buffer is acquired here unless provided by
+// the caller. Only the pwrite path stops at the end of a range shortened
+// by the scheduler
+void SetDownloadTarget(const Args& args, WebClient& req,
+                       RangeScheduler& scheduler, int worker, size_t offset,
+                       BufferPool::Buffer buffer = {}) {
+    if (args.ioURing) {
+        req.SetDownloadFileURing(args.file, offset, size_t(1) << 20,
+                                 args.direct);
+    } else if (args.bufferPool) {
+        if (!buffer) buffer = args.bufferPool->Acquire();
+        req.SetDownloadFileDirect(args.file, offset, move(buffer));
+    } else {
+        req.SetDownloadFile(args.fd, offset, size_t(4) << 20,
+                            [&scheduler, worker](size_t n) {
+                                return scheduler.Advance(worker, n);
+                            });
+    }
+}
+
+// Build duplicate of slow range download requesting the part of the range
+// not received yet, returned by RangeScheduler::Remaining(); both transfers
+// write the same bytes to the shared output file. Return nullptr when no
+// concurrency slot is available or nothing is left to download
+unique_ptr<WebClient> BuildHedge(const Args& args, const string& path,
+                                 const RangeScheduler::Range& range,
+                                 ConcurrencyController* concurrency) {
+    if (range.end <= range.begin) return nullptr;
+    if (concurrency && !concurrency->TryAcquire(args.endpoint)) {
+        return nullptr;
+    }
+    unique_ptr<WebClient> req(
+        new WebClient(BuildDownloadRequest(args, path, range)));
+    req->SetDownloadFile(args.fd, range.begin);
+    return req;
+}
+
+// Record completion of range download, a download cancelled because its
+// duplicate completed first only releases its slot
+void EndRange(ConcurrencyController* concurrency, const Args& args,
+              const WebClient& req, size_t bytes) {
+    if (!req.Cancelled()) UpdateConcurrency(concurrency, args, req, bytes);
+    if (concurrency) concurrency->Release(args.endpoint);
+}
+
+// Record range written to output file into the journal, the data is
+// flushed first so that the journal never refers to data lost in a crash
+void RecordRange(const Args& args, size_t begin, size_t end) {
+    if (!args.journal) return;
+    if (fdatasync(args.fd) != 0) {
+        throw runtime_error("Error writing file " + args.file + ": " +
+                            strerror(errno));
+    }
+    args.journal->AddRange(begin, end);
+}
+
+// Create output file and reserve space for the whole object, so that parts
+// written in any order do not fragment the file; when resuming the file
+// must exist and is not truncated
+int CreateOutputFile(const string& fname, size_t size, bool resume = false) {
+    const int flags = resume ? O_WRONLY | O_LARGEFILE
+                             : O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE;
+    const int fd = open(fname.c_str(), flags, 0644);
+    if (fd < 0) {
+        throw runtime_error("Cannot open file " + fname + ": " +
+                            strerror(errno));
+    }
+    if (size > 0 && fallocate(fd, 0, 0, off_t(size)) != 0 &&
+        ftruncate(fd, off_t(size)) != 0) {
+        // file system without fallocate support: only set size
+        const int err = errno;
+        close(fd);
+        throw runtime_error("Cannot resize file " + fname + ": " +
+                            strerror(err));
+    }
+    return fd;
+}
+
+// Download ranges assigned to worker until none is left, return status
+// of last request or -1 on transfer or file write error. Transient
+// failures are retried after a backoff delay with a newly signed request
+// for the part of the range not written yet
+int DownloadRanges(const Args& args, const string& path,
+                   RangeScheduler* scheduler, int worker,
+                   ConcurrencyController* concurrency) {
+    RangeScheduler::Range range;
+    int status = 0;
+    while (scheduler->Next(worker, range)) {
+        RangeScheduler::Range rest = range;
+        for (int retry = 0;; ++retry) {
+            if (concurrency) concurrency->Acquire(args.endpoint);
+            WebClient req = BuildDownloadRequest(args, path, rest);
+            SetDownloadTarget(args, req, *scheduler, worker, rest.begin);
+            const size_t sz = rest.end - rest.begin;
+            auto end = [&](WebClient& r) {
+                EndRange(concurrency, args, r, sz);
+            };
+            bool ok = false;
+            if (args.hedge) {
+                ok = SendHedged(*args.hedge, sz, req,
+                                [&]() {
+                                    return BuildHedge(
+                                        args, path,
+                                        scheduler->Remaining(worker),
+                                        concurrency);
+                                },
+                                end);
+            } else {
+                ok = req.Send();
+                end(req);
+            }
+            // an error response is reported even when its transfer failed,
+            // -1 is left for transport and file write errors
+            status = ok || req.StatusCode() > 300 ? int(req.StatusCode()) : -1;
+            if (!args.retryPolicy.Retry(RetryPolicy::Classify(req), retry)) {
+                break;
+            }
+            rest = scheduler->Remaining(worker);
+            // the whole range was written before the failure
+            if (rest.end <= rest.begin) {
+                status = req.StatusCode();
+                break;
+            }
+            this_thread::sleep_for(args.retryPolicy.Delay(retry));
+        }
+        // the tail received by a duplicate must not be split
+        const size_t end = scheduler->Complete(worker);
+        if (status < 0 || status > 300) break;
+        RecordRange(args, range.begin, end);
+    }
+    return status;
+}
+
+// Download ranges through event loops: each thread drives up to
+// jobs / eventLoops ranges through a TransferEngine, each transfer slot
+// is a scheduler worker. A transient failure is retried after a backoff
+// delay for the part of the range not written yet, keeping the worker,
+// concurrency slot and O_DIRECT buffer of the failed transfer.
+void DownloadRangesAsync(const Args& args, const string& path,
+                         RangeScheduler& scheduler,
+                         ConcurrencyController* concurrency) {
+    using SourceStatus = TransferEngine::SourceStatus;
+    using Range = RangeScheduler::Range;
+    const int inFlight = (args.jobs + args.eventLoops - 1) / args.eventLoops;
+    atomic<bool> failed{false};
+    auto eventLoop = [&](int loop) {
+        TransferEngine engine(inFlight);
+        if (args.maxStreams > 0) {
+            engine.SetMaxConcurrentStreams(args.maxStreams);
+        }
+        engine.SetHedgePolicy(args.hedge.get());
+        vector<int> freeWorkers;
+        for (int w = 0; w != inFlight; ++w) {
+            freeWorkers.push_back(loop * inFlight + w);
+        }
+        // add transfer of the rest of the range starting at begin, retries
+        // are added after a delay and are not hedged
+        function<void(int, size_t, Range, int, BufferPool::Buffer)> add;
+        // complete or retry the range of worker when its transfer ends; a
+        // transfer cancelled because its duplicate completed first, or
+        // because it failed while its duplicate was in flight, leaves the
+        // range to the other transfer
+        auto finish = [&](WebClient& c, bool ok, int worker, size_t begin,
+                          int retry, size_t sz) {
+            if (c.Cancelled()) {
+                EndRange(concurrency, args, c, sz);
+                return;
+            }
+            if (!failed &&
+                args.retryPolicy.Retry(RetryPolicy::Classify(c), retry)) {
+                const Range next = scheduler.Remaining(worker);
+                if (next.end > next.begin) {
+                    UpdateConcurrency(concurrency, args, c, sz);
+                    add(worker, begin, next, retry + 1,
+                        c.ReleaseDownloadBuffer());
+                    return;
+                }
+                // the whole range was written before the failure
+                ok = true;
+            }
+            EndRange(concurrency, args, c, sz);
+            freeWorkers.push_back(worker);
+            const size_t end = scheduler.Complete(worker);
+            if (!ok || c.StatusCode() > 300) {
+                if (c.StatusCode() == 412) {
+                    cerr << "Object changed since download started" << endl;
+                }
+                failed = true;
+                return;
+            }
+            RecordRange(args, begin, end);
+        };
+        add = [&](int worker, size_t begin, Range rest, int retry,
+                  BufferPool::Buffer buffer) {
+            unique_ptr<WebClient> req(
+                new WebClient(BuildDownloadRequest(args, path, rest)));
+            SetDownloadTarget(args, *req, scheduler, worker, rest.begin,
+                              move(buffer));
+            const size_t sz = rest.end - rest.begin;
+            TransferEngine::Completion done =
+                [&, worker, begin, retry, sz](WebClient& c, bool ok) {
+                    finish(c, ok, worker, begin, retry, sz);
+                };
+            if (retry > 0) {
+                engine.AddAfter(args.retryPolicy.Delay(retry - 1), move(req),
+                                move(done));
+                return;
+            }
+            engine.AddHedged(
+                move(req), move(done), sz,
+                [&, worker, begin](TransferEngine::Completion& done) {
+                    // the duplicate completes the range up to its end
+                    const Range rest = scheduler.Remaining(worker);
+                    unique_ptr<WebClient> h =
+                        BuildHedge(args, path, rest, concurrency);
+                    if (!h) return h;
+                    const size_t sz = rest.end - rest.begin;
+                    done = [&, worker, begin, sz](WebClient& c, bool ok) {
+                        finish(c, ok, worker, begin, 0, sz);
+                    };
+                    return h;
+                });
+        };
+        try {
+            engine.Run([&](TransferEngine& e) {
+                if (failed) return SourceStatus::DONE;
+                // in-flight ranges can still be split while waiting
+                const SourceStatus idle = e.InFlight() == 0
+                                              ? SourceStatus::DONE
+                                              : SourceStatus::WAIT;
+                if (freeWorkers.empty()) return SourceStatus::WAIT;
+                // do not block the event loop when memory budget is used up
+                BufferPool::Buffer buffer;
+                if (args.bufferPool) {
+                    buffer = args.bufferPool->TryAcquire();
+                    if (!buffer) return SourceStatus::WAIT;
+                }
+                if (concurrency && !concurrency->TryAcquire(args.endpoint)) {
+                    return SourceStatus::WAIT;
+                }
+                const int worker = freeWorkers.back();
+                Range range;
+                if (!scheduler.Next(worker, range)) {
+                    if (concurrency) concurrency->Release(args.endpoint);
+                    return idle;
+                }
+                freeWorkers.pop_back();
+                try {
+                    add(worker, range.begin, range, 0, move(buffer));
+                } catch (const exception& e) {
+                    cerr << e.what() << endl;
+                    failed = true;
+                    return SourceStatus::DONE;
+                }
+                return SourceStatus::ADDED;
+            });
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            failed = true;
+        }
+    };
+    vector<thread> loops;
+    for (int i = 0; i != args.eventLoops; ++i) {
+        loops.push_back(thread(eventLoop, i));
+    }
+    for (auto& l : loops) l.join();
+    if (failed) throw runtime_error("Error downloading file");
+}
+
+// Range written into a reorder buffer
+struct StreamTarget {
+    ReorderBuffer* buffer;
+    size_t offset;  // next byte
+    size_t end;     // one past last byte of range
+};
+
+// Store received data into the reorder buffer; data past the end of the
+// range, e.g. an error response body, aborts the transfer
+size_t StreamWriter(char* data, size_t size, size_t nmemb, void* ptr) {
+    StreamTarget* target = static_cast<StreamTarget*>(ptr);
+    const size_t n = size * nmemb;
+    if (n > target->end - target->offset) return 0;
+    target->buffer->Write(target->offset, data, n);
+    target->offset += n;
+    return n;
+}
+
+// Stream object to standard output: consecutive ranges are downloaded by
+// jobs threads, or through event loops, into a reorder buffer written out
+// in order by the calling thread. Ranges are assigned in order and a range
+// is requested only when it fits into the buffer, so that the transfers
+// are throttled by the consumer.
+void StreamRanges(const Args& args, const string& path, size_t size,
+                  size_t rangeSize, size_t capacity,
+                  ConcurrencyController* concurrency) {
+    using Range = RangeScheduler::Range;
+    ReorderBuffer buffer(STDOUT_FILENO, capacity);
+    atomic<size_t> next{0};  // first byte of next range
+    atomic<bool> failed{false};
+    auto fail = [&]() {
+        failed = true;
+        buffer.Abort();
+    };
+    // record outcome of range transfer
+    auto rangeDone = [&](const WebClient& req, bool ok, const Range& range,
+                         const StreamTarget& target) {
+        UpdateConcurrency(concurrency, args, req, range.end - range.begin);
+        if (concurrency) concurrency->Release(args.endpoint);
+        if (!ok || req.StatusCode() > 300 || target.offset != range.end) {
+            if (req.StatusCode() > 300) {
+                cerr << "Error downloading range " << range.begin << "-"
+                     << range.end - 1 << " - HTTP status "
+                     << req.StatusCode() << endl;
+            }
+            fail();
+        } else {
+            buffer.Complete(range.begin, range.end);
+        }
+    };
+    auto worker = [&]() {
+        try {
+            for (size_t b = next.fetch_add(rangeSize); b < size;
+                 b = next.fetch_add(rangeSize)) {
+                const Range range{b, min(b + rangeSize, size)};
+                if (!buffer.Reserve(range.begin, range.end)) return;
+                if (concurrency) concurrency->Acquire(args.endpoint);
+                StreamTarget target{&buffer, range.begin, range.end};
+                WebClient req = BuildDownloadRequest(args, path, range);
+                req.SetWriteFunction(StreamWriter, &target);
+                const bool ok = req.Send();
+                rangeDone(req, ok, range, target);
+                if (!ok || failed) return;
+            }
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            fail();
+        }
+    };
+    auto eventLoop = [&]() {
+        using SourceStatus = TransferEngine::SourceStatus;
+        const int inFlight =
+            (args.jobs + args.eventLoops - 1) / args.eventLoops;
+        TransferEngine engine(inFlight);
+        if (args.maxStreams > 0) {
+            engine.SetMaxConcurrentStreams(args.maxStreams);
+        }
+        size_t pending = size;  // range waiting for space in the buffer
+        try {
+            engine.Run([&](TransferEngine& e) {
+                if (failed) return SourceStatus::DONE;
+                if (pending >= size) pending = next.fetch_add(rangeSize);
+                if (pending >= size) {
+                    return e.InFlight() == 0 ? SourceStatus::DONE
+                                             : SourceStatus::WAIT;
+                }
+                const Range range{pending, min(pending + rangeSize, size)};
+                if (!buffer.TryReserve(range.begin, range.end)) {
+                    return buffer.Aborted() ? SourceStatus::DONE
+                                            : SourceStatus::WAIT;
+                }
+                if (concurrency && !concurrency->TryAcquire(args.endpoint)) {
+                    return SourceStatus::WAIT;
+                }
+                pending = size;
+                // completion function owns the target written by libcurl
+                auto target = make_shared<StreamTarget>(
+                    StreamTarget{&buffer, range.begin, range.end});
+                unique_ptr<WebClient> req(
+                    new WebClient(BuildDownloadRequest(args, path, range)));
+                req->SetWriteFunction(StreamWriter, target.get());
+                e.Add(move(req), [&, range, target](WebClient& c, bool ok) {
+                    rangeDone(c, ok, range, *target);
+                });
+                return SourceStatus::ADDED;
+            });
+        } catch (const exception& e) {
+            cerr << e.what() << endl;
+            fail();
+        }
+    };
+    vector<thread> threads;
+    if (args.eventLoops > 0) {
+        for (int i = 0; i != args.eventLoops; ++i) {
+            threads.push_back(thread(eventLoop));
+        }
+    } else {
+        for (int i = 0; i != args.jobs; ++i) threads.push_back(thread(worker));
+    }
+    // output fails e.g. when the reader closes the pipe
+    const bool writeError = !buffer.Drain(size) && !failed;
+    if (writeError) fail();
+    for (auto& t : threads) t.join();
+    if (writeError) throw runtime_error("Error writing to standard output");
+    if (failed) throw runtime_error("Error downloading file");
 }
 
 //------------------------------------------------------------------------------
@@ -145,10 +657,71 @@ int main(int argc, char const* argv[]) {
             lyra::opt(args.bucket, "bucket")["-b"]["--bucket"]("Bucket name")
                 .required() |
             lyra::opt(args.key, "key")["-k"]["--key"]("Key name").required() |
-            lyra::opt(args.file, "file")["-f"]["--file"]("File name")
-                .required() |
+            lyra::opt(args.file, "file")["-f"]["--file"](
+                "File name, '-' for standard output")
+                .optional() |
+            lyra::opt(args.toStdout)["--stdout"](
+                "Write object to standard output in order, e.g. to pipe "
+                "it into another program; ranges are downloaded in "
+                "parallel into a buffer of --buffer-memory size")
+                .optional() |
             lyra::opt(args.jobs, "parallel jobs")["-j"]["--jobs"](
                 "Number inputFile parallel jobs")
+                .optional() |
+            lyra::opt(args.rangeSize, "range size")["-R"]["--range-size"](
+                "Size of ranges distributed to jobs, e.g. 64M; idle jobs "
+                "take ranges from other jobs; default: 64 MiB, 8 MiB with "
+                "--stdout")
+                .optional() |
+            lyra::opt(args.eventLoops, "event loops")["-E"]["--event-loops"](
+                "Number of threads driving parts through curl_multi event "
+                "loops, 0 = one thread per job")
+                .optional() |
+            lyra::opt(args.http, "HTTP version")["--http"](
+                "HTTP version: 1.1 | 2 | h2c (HTTP/2 prior knowledge); "
+                "parts are multiplexed over HTTP/2 with --event-loops")
+                .optional() |
+            lyra::opt(args.maxStreams, "max streams")["--max-streams"](
+                "Max number of concurrent HTTP/2 streams per connection")
+                .optional() |
+            lyra::opt(args.adaptive)["--adaptive"](
+                "Adapt number of concurrent parts to throughput and "
+                "throttling, up to the number of jobs")
+                .optional() |
+            lyra::opt(args.hedgeBudget, "ratio")["--hedge"](
+                "Send a duplicate request for the rest of ranges slower than "
+                "the 95th percentile, cancelling the slower one; max ratio "
+                "of duplicates to ranges, e.g. 0.05; default: disabled")
+                .optional() |
+            lyra::opt(args.journalPath, "journal file")["--resume"](
+                "Journal file recording the ranges written to the output "
+                "file; if the file exists only missing ranges are "
+                "downloaded, provided the object did not change")
+                .optional() |
+            lyra::opt(args.ioURing)["--io-uring"](
+                "Write parts through io_uring")
+                .optional() |
+            lyra::opt(args.direct)["--direct"](
+                "Bypass page cache (O_DIRECT); without --io-uring parts are "
+                "written from reusable 1 MiB buffers")
+                .optional() |
+            lyra::opt(args.bufferMemory, "size")["--buffer-memory"](
+                "Max memory used by --direct buffers, e.g. 1G; parts wait "
+                "for a free buffer; default: one buffer per job. With "
+                "--stdout size of the reorder buffer, ranges wait until "
+                "the data before them is written out; default: two "
+                "ranges per job")
+                .optional() |
+            lyra::opt(args.hugePages)["--huge-pages"](
+                "Allocate --direct buffers from huge pages")
+                .optional() |
+            lyra::opt(args.maxRetries, "Max retries")["-r"]["--retries"](
+                "Max number of retries per range, transient errors only; "
+                "a range is resumed from the first byte not written")
+                .optional() |
+            lyra::opt(args.retryDelay, "retry delay")["--retry-delay"](
+                "Base retry delay in milliseconds, doubled at each retry and "
+                "randomized")
                 .optional();
 
         // Parse the program arguments:
@@ -163,33 +736,130 @@ int main(int argc, char const* argv[]) {
             return 0;
         }
         Validate(args);
+        args.httpVersion = ParseHTTPVersion(args.http);
+        args.host = HostHeader(args.endpoint);
+        args.signer.reset(new SigV4Signer(args.s3AccessKey, args.s3SecretKey));
+        args.retryPolicy = RetryPolicy(
+            args.maxRetries, RetryPolicy::Duration(args.retryDelay));
+        if (args.hedgeBudget > 0) {
+            args.hedge.reset(new HedgePolicy(args.hedgeBudget));
+        }
+        if (args.direct && !args.ioURing) {
+            const size_t bufferSize = size_t(1) << 20;
+            const size_t budget = args.bufferMemory.empty()
+                                      ? bufferSize * args.jobs
+                                      : ParseSize(args.bufferMemory);
+            args.bufferPool.reset(
+                new BufferPool(bufferSize, budget, args.hugePages));
+        }
         string path = "/" + args.bucket + "/" + args.key;
         vector<future<int>> status(args.jobs);
-        if (args.jobs > 1) {
-            // retrieve file size from remote object
-            const size_t fileSize = ObjectSize(args, path);
-            // compute chunk size
-            const size_t chunkSize = fileSize / args.jobs;
-            // compute last chunk size
-            const size_t lastChunkSize =
-                fileSize % args.jobs == 0 ? chunkSize : fileSize % args.jobs;
-            // create output file
-            std::ofstream ofs(args.file, std::ios::binary | std::ios::out);
-            ofs.seekp(fileSize);
-            ofs.write("", 1);
-            ofs.close();
-            // initiate request
-            for (int i = 0; i != args.jobs; ++i) {
-                status[i] = async(launch::async, DownloadPart, args, path, i,
-                                  chunkSize, lastChunkSize);
+        // retrieve file size from remote object
+        const ObjectInfo object = HeadObject(args, path);
+        const size_t fileSize = object.size;
+        args.etag = object.etag;
+        unique_ptr<ConcurrencyController> concurrency;
+        if (args.adaptive) {
+            concurrency.reset(new ConcurrencyController(args.jobs));
+        }
+        if (args.toStdout || args.file == "-") {
+            // smaller ranges so that data starts flowing sooner
+            const size_t rangeSize = args.rangeSize.empty()
+                                         ? size_t(8) << 20
+                                         : ParseSize(args.rangeSize);
+            const size_t capacity = args.bufferMemory.empty()
+                                        ? 2 * rangeSize * args.jobs
+                                        : ParseSize(args.bufferMemory);
+            if (rangeSize == 0 || capacity < rangeSize) {
+                throw invalid_argument(
+                    "ERROR: buffer memory must not be smaller than range "
+                    "size");
+            }
+            StreamRanges(args, path, fileSize, rangeSize, capacity,
+                         concurrency.get());
+            return 0;
+        }
+        // ranges are split only when the writer can stop at a new end
+        const size_t rangeSize = args.rangeSize.empty()
+                                     ? size_t(64) << 20
+                                     : ParseSize(args.rangeSize);
+        const bool split = !args.ioURing && !args.bufferPool;
+        const int numWorkers =
+            args.eventLoops > 0
+                ? args.eventLoops *
+                      ((args.jobs + args.eventLoops - 1) / args.eventLoops)
+                : args.jobs;
+        // when resuming only the ranges missing from the output file are
+        // downloaded, if the object did not change
+        vector<RangeScheduler::Range> ranges = {{0, fileSize}};
+        bool resume = false;
+        if (!args.journalPath.empty()) {
+            args.journal.reset(new DownloadJournal(args.journalPath));
+            const DownloadJournal& journal = *args.journal;
+            if (journal.HasDownload()) {
+                if (journal.Bucket() != args.bucket ||
+                    journal.Key() != args.key) {
+                    throw invalid_argument("ERROR: journal " +
+                                           args.journalPath +
+                                           " refers to a different download");
+                }
+                if (journal.ETag() != object.etag ||
+                    journal.ObjectSize() != fileSize ||
+                    journal.LastModified() != object.lastModified) {
+                    throw runtime_error(
+                        "ERROR: object changed since download started, "
+                        "remove journal " +
+                        args.journalPath + " to download it again");
+                }
+                ranges.clear();
+                for (const auto& r : journal.Missing()) {
+                    ranges.push_back({r.first, r.second});
+                }
+                resume = true;
+            } else if (object.etag.empty()) {
+                throw runtime_error(
+                    "ERROR: object has no etag, download cannot be resumed");
+            }
+        }
+        RangeScheduler scheduler(ranges, rangeSize, numWorkers,
+                                 split ? size_t(1) << 20 : 0);
+        // output file opened once and shared by all parts
+        args.fd = CreateOutputFile(args.file, fileSize, resume);
+        if (args.journal && !resume) {
+            args.journal->Begin(args.bucket, args.key, fileSize, object.etag,
+                                object.lastModified);
+        }
+        try {
+            if (args.eventLoops > 0) {
+                DownloadRangesAsync(args, path, scheduler, concurrency.get());
+            } else {
+                for (int i = 0; i != args.jobs; ++i) {
+                    status[i] = async(launch::async, DownloadRanges, args,
+                                      path, &scheduler, i, concurrency.get());
+                }
+                // wait for every worker before the scheduler goes away
+                for (auto& i : status) i.wait();
+                for (auto& i : status) {
+                    const int s = i.get();
+                    if (s == 412) {
+                        throw runtime_error(
+                            "Object changed since download started");
+                    }
+                    if (s < 0 || s > 300)
+                        throw runtime_error("Error downloading file");
+                }
             }
-            for (auto& i : status) {
-                if (i.get() > 300)
-                    throw runtime_error("Error downloading file");
+        } catch (...) {
+            if (args.journal) {
+                cerr << "Download interrupted, run again with --resume "
+                     << args.journalPath << " to resume" << endl;
             }
-        } else {
-            throw runtime_error("NOT IMPLEMENTED");
+            throw;
+        }
+        if (close(args.fd)) {
+            throw runtime_error("Error writing file " + args.file);
         }
+        if (args.journal) args.journal->Remove();
         return 0;
     } catch (const exception& e) {
         cerr << e.what() << endl;
@@ -35,22 +35,40 @@
 
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <cerrno>
 #include <chrono>
-#include <future>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <regex>
 #include <set>
 #include <stdexcept>
+#include <thread>
 #include <vector>
-#include <chrono>
 
 
 #include "aws_sign.h"
+#include "buffer_pool.h"
+#include "checksum.h"
+#include "concurrency_controller.h"
+#include "endpoint_selector.h"
+#include "hedge_policy.h"
 #include "lyra/lyra.hpp"
+#include "part_hasher.h"
 #include "response_parser.h"
+#include "retry_policy.h"
+#include "sha256_fast.h"
+#include "transfer_engine.h"
+#include "upload_journal.h"
 #include "utility.h"
 #include "webclient.h"
 #include "common.h"
@@ -72,9 +90,44 @@ struct Config {
     string awsProfile;
     vector<string> endpoints;
     int maxRetries = 2;
+    int retryDelay = 100;
+    RetryPolicy retryPolicy;
     int jobs = 1;
+    string partSize;
+    int eventLoops = 0;
+    string http;
+    HTTPVersion httpVersion = HTTPVersion::DEFAULT;
+    long maxStreams = 0;
+    string journal;
+    bool adaptive = false;
+    shared_ptr<ConcurrencyController> concurrency;
+    int cooldown = 30;
+    shared_ptr<EndpointSelector> selector;
+    string readAhead;
+    size_t readAheadSize = 0;
+    bool ioURing = false;
+    bool direct = false;
+    string bufferMemory;
+    bool hugePages = false;
+    shared_ptr<BufferPool> bufferPool;
+    double hedgeBudget = 0;
+    shared_ptr<HedgePolicy> hedge;
+    bool fromStdin = false;  // also selected with "-f -"
+    shared_ptr<SigV4Signer> signer;  // signs part uploads
+    map<string, string> hosts;       // "host" header of each endpoint
+    bool signPayload = false;
+    bool signChunks = false;  // payload signed while sent, aws-chunked
+    shared_ptr<PartHasher> partHashes;  // payload hashes of file parts
+    string checksum;  // full object checksum algorithm, none if empty
+    ChecksumAlgorithm checksumAlgorithm = ChecksumAlgorithm::CRC32C;
 };
 
+// S3 limits, see
+// https://docs.aws.amazon.com/AmazonS3/latest/userguide/qfacts.html
+const size_t MIN_PART_SIZE = size_t(5) << 20;  // except last part
+const size_t MAX_PART_SIZE = size_t(5) << 30;
+const size_t MAX_NUM_PARTS = 10000;
+
 vector<string> ReadEndpoints(const string& fname) {
     vector<string> ep;
     ifstream in(fname);
@@ -107,11 +160,49 @@ void Validate(const Config& config) {
             "ERROR: number of jobs must be greater than one, " +
             to_string(config.jobs) + " provided");
     }
-    if (config.maxRetries < 1) {
+    if (config.eventLoops < 0 || config.eventLoops > config.jobs) {
+        throw invalid_argument(
+            "ERROR: number of event loops must be in range [0, jobs], " +
+            to_string(config.eventLoops) + " provided");
+    }
+    if (config.maxRetries < 0) {
         throw invalid_argument(
-            "ERROR: number of retries must be greater than one, " +
+            "ERROR: number of retries must not be negative, " +
             to_string(config.maxRetries) + " provided");
     }
+    if (config.cooldown < 0) {
+        throw invalid_argument(
+            "ERROR: endpoint cooldown must not be negative, " +
+            to_string(config.cooldown) + " provided");
+    }
+    if (config.retryDelay < 0) {
+        throw invalid_argument(
+            "ERROR: retry delay must not be negative, " +
+            to_string(config.retryDelay) + " provided");
+    }
+    if (config.file.empty() && !config.fromStdin) {
+        throw invalid_argument("ERROR: no input file specified");
+    }
+    if ((config.fromStdin || config.file == "-") &&
+        (!config.journal.empty() || config.eventLoops > 0 ||
+         config.ioURing || config.direct)) {
+        throw invalid_argument(
+            "ERROR: --resume, --event-loops, --io-uring and --direct not "
+            "supported when reading from standard input");
+    }
+    if (config.signPayload && config.signChunks) {
+        throw invalid_argument(
+            "ERROR: --sign-payload and --sign-chunks are mutually exclusive");
+    }
+    if (config.signPayload && !config.checksum.empty()) {
+        throw invalid_argument(
+            "ERROR: --sign-payload and --checksum are mutually exclusive");
+    }
+    if (config.hedgeBudget < 0 || config.hedgeBudget > 1) {
+        throw invalid_argument(
+            "ERROR: hedge budget must be in range [0, 1], " +
+            to_string(config.hedgeBudget) + " provided");
+    }
 #ifdef VALIDATE_URL
     const URL url = ParseURL(config.endpoint);
     if (url.proto != "http" && url.proto != "https") {
@@ -134,75 +225,893 @@ void Validate(const Config& config) {
 using Headers = Map;
 using Parameters = Map;
 
-atomic<int> numRetriesG{0};
+// Send request returned by build function, retrying transient failures
+// after a backoff delay: the request is built, and therefore signed, again
+// before each attempt. The send function sends the request, the optional
+// valid function can reject successful responses e.g. missing ETag.
+// Returns the last request sent, number of retries is added to retries.
+WebClient SendWithRetry(
+    const Config& config, const function<WebClient()>& build,
+    const function<bool(WebClient&)>& send, int& retries,
+    const function<bool(const WebClient&)>& valid = nullptr) {
+    for (int retry = 0;; ++retry) {
+        WebClient req = build();
+        send(req);
+        RequestStatus status = RetryPolicy::Classify(req);
+        if (status == RequestStatus::OK && valid && !valid(req)) {
+            status = RequestStatus::RETRY;
+        }
+        if (!config.retryPolicy.Retry(status, retry)) return req;
+        ++retries;
+        this_thread::sleep_for(config.retryPolicy.Delay(retry));
+    }
+}
+
+bool SendRequest(WebClient& req) { return req.Send(); }
+
+// Return least loaded healthy endpoint
+const string& SelectEndpoint(const Config& config) {
+    return config.selector->Endpoint(config.selector->Select());
+}
+
+// Update concurrency window of endpoint with outcome of request
+void UpdateConcurrency(const Config& config, const string& endpoint,
+                       const WebClient& req, size_t bytes) {
+    if (!config.concurrency) return;
+    config.concurrency->Update(endpoint, RetryPolicy::Classify(req),
+                               req.StatusCode(), req.TransferTime(), bytes);
+}
+
+// Size of reads through io_uring or O_DIRECT buffers
+size_t SliceSize(const Config& config) {
+    return config.readAheadSize > 0 ? config.readAheadSize : size_t(1) << 20;
+}
+
+// Configure upload of file region, reading through io_uring, O_DIRECT
+// buffers or read-ahead threads when requested; the pool buffer is
+// acquired here unless provided by the caller
+void SetUploadSource(const Config& config, WebClient& req, size_t offset,
+                     size_t size, BufferPool::Buffer buffer = {}) {
+    if (config.ioURing) {
+        req.SetUploadFileURing(config.file, offset, size, SliceSize(config),
+                               config.direct);
+    } else if (config.bufferPool) {
+        if (!buffer) buffer = config.bufferPool->Acquire();
+        req.SetUploadFileDirect(config.file, offset, size, move(buffer));
+    } else {
+        req.SetUploadFile(config.file, offset, size, config.readAheadSize);
+    }
+}
+
+// Size of payload data in each signed chunk: the size of reads from file
+size_t ChunkSize(const Config& config) {
+    return max(SliceSize(config), AwsChunkedEncoder::MIN_CHUNK_SIZE);
+}
+
+// Payloads are sent with aws-chunked encoding when signed chunk by chunk or
+// followed by a checksum trailer
+bool Chunked(const Config& config) {
+    return config.signChunks || !config.checksum.empty();
+}
+
+// Name of checksum trailer header, empty if no checksum
+string Trailer(const Config& config) {
+    return config.checksum.empty() ? ""
+                                   : ChecksumHeader(config.checksumAlgorithm);
+}
+
+// Configure part upload from memory when \c data is not null, from the
+// input file otherwise; with --sign-chunks the payload is signed while sent,
+// with --checksum its checksum is computed while sent
+void SetPartSource(const Config& config, WebClient& req, size_t offset,
+                   size_t size, const char* data,
+                   BufferPool::Buffer buffer = {}) {
+    if (data) {
+        req.SetUploadBuffer(data, size);
+    } else {
+        SetUploadSource(config, req, offset, size, move(buffer));
+    }
+    if (Chunked(config)) {
+        req.SetChunkedEncoding(ChunkSize(config), config.signChunks
+                                                      ? config.signer.get()
+                                                      : nullptr);
+    }
+}
+
+// Return checksum of part sent by completed request
+Checksum PartChecksum(const WebClient& req, size_t i, size_t size) {
+    const Checksum* checksum = req.PayloadChecksum();
+    if (!checksum || checksum->Size() != size) {
+        throw runtime_error("Cannot upload part " + to_string(i + 1) +
+                            " - incomplete checksum");
+    }
+    return *checksum;
+}
+
+// Compute checksum of file region, used for parts uploaded before the
+// upload was resumed
+Checksum FileChecksum(const Config& config, size_t offset, size_t size) {
+    const int fd = open(config.file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open file " + config.file + ": " +
+                            strerror(errno));
+    }
+    Checksum checksum(config.checksumAlgorithm);
+    vector<char> buffer(min(size, size_t(1) << 20));
+    while (size > 0) {
+        const ssize_t r =
+            pread(fd, buffer.data(), min(size, buffer.size()), off_t(offset));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            close(fd);
+            throw runtime_error("Error reading file " + config.file);
+        }
+        checksum.Add(buffer.data(), size_t(r));
+        offset += size_t(r);
+        size -= size_t(r);
+    }
+    close(fd);
+    return checksum;
+}
+
+// Return signed payload hash of part read from memory when \c data is not
+// null, from the input file otherwise; empty if payload is not signed or
+// signed chunk by chunk
+string PayloadHash(const Config& config, int partNum, const char* data,
+                   size_t size) {
+    if (!config.signPayload) return "";
+    return data ? Sha256Hex(data, size) : config.partHashes->Hash(partNum);
+}
 
-WebClient BuildUploadRequest(const Config& config, const string& path,
-                             int partNum, const string& uploadId) {
+// Build part upload request, \c data is not null for parts read from memory
+WebClient BuildUploadRequest(const Config& config, const string& endpoint,
+                             const string& path, int partNum,
+                             const string& uploadId, const char* data,
+                             size_t size) {
     Parameters params = {{"partNumber", to_string(partNum + 1)},
                          {"uploadId", uploadId}};
-    const string endpoint = config.endpoints[partNum % config.endpoints.size()];
-    auto signedHeaders =
-        SignHeaders(config.s3AccessKey, config.s3SecretKey, endpoint, "PUT",
-                    config.bucket, config.key, "", params);
-    Headers headers(begin(signedHeaders), end(signedHeaders));
-    WebClient req(endpoint, path, "PUT", params, headers);
+    const string& host = config.hosts.at(endpoint);
+    if (Chunked(config)) {
+        // the chunked encoder signs chunks with the stored headers
+        auto signedHeaders =
+            SignStreamingHeaders(*config.signer, host, "PUT", path, size,
+                                 params, Trailer(config), config.signChunks);
+        Headers headers(begin(signedHeaders), end(signedHeaders));
+        WebClient req(endpoint, path, "PUT", params, headers);
+        req.SetHTTPVersion(config.httpVersion);
+        return req;
+    }
+    // signed headers are passed to the client as views of per-thread
+    // buffers, with no header map built for each part
+    thread_local string id;  // upload id encoded into encodedId
+    thread_local string encodedId;
+    thread_local string query;
+    thread_local string authorization;
+    if (id != uploadId) {
+        id = uploadId;
+        encodedId = UrlEncode(uploadId);
+    }
+    query.assign("partNumber=");
+    query.append(to_string(partNum + 1));
+    query.append("&uploadId=");
+    query.append(encodedId);
+    const string payload = PayloadHash(config, partNum, data, size);
+    char ts[SigV4Signer::TIMESTAMP_SIZE + 1];
+    SigV4Signer::TimeStamp(ts);
+    const HeaderSpan headers[] = {
+        {"host", host},
+        {"x-amz-content-sha256",
+         payload.empty() ? string_view("UNSIGNED-PAYLOAD") : payload},
+        {"x-amz-date", ts}};
+    SigV4Request sr;
+    sr.method = "PUT";
+    sr.canonicalURI = path;
+    sr.canonicalQuery = query;
+    sr.headers = headers;
+    sr.numHeaders = std::size(headers);
+    sr.payloadHash = headers[1].value;
+    sr.timeStamp = ts;
+    config.signer->Sign(sr, authorization);
+    WebClient req(endpoint, path, "PUT", params);
+    for (const HeaderSpan& h : headers) req.AddHeader(h.name, h.value);
+    req.AddHeader("Authorization", authorization);
+    req.SetHTTPVersion(config.httpVersion);
     return req;
 }
 
-string BuildEndUploadXML(vector<future<string>>& etags) {
+// Part checksums are added when \c checksums is not null
+string BuildEndUploadXML(const vector<string>& etags,
+                         const vector<Checksum>* checksums) {
     string xml =
         "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
         "<CompleteMultipartUpload "
         "xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">\n";
     for (int i = 0; i != etags.size(); ++i) {
-        if (!etags[i].valid()) {
+        if (etags[i].empty()) {
             throw runtime_error("Error - request " + to_string(i));
             return "";
         }
-        const string part = "<Part><ETag>" + etags[i].get() +
-                            "</ETag><PartNumber>" + to_string(i + 1) +
-                            "</PartNumber></Part>";
+        string part = "<Part><ETag>" + etags[i] + "</ETag>";
+        if (checksums) {
+            const Checksum& c = (*checksums)[i];
+            const string tag =
+                string("Checksum") + ChecksumName(c.Algorithm());
+            part += "<" + tag + ">" + c.Base64() + "</" + tag + ">";
+        }
+        part += "<PartNumber>" + to_string(i + 1) + "</PartNumber></Part>";
         xml += part;
     }
     xml += "</CompleteMultipartUpload>";
     return xml;
 }
 
+// Headers declaring the full object checksum of a multipart upload
+Headers ChecksumTypeHeaders(const Config& config) {
+    if (config.checksum.empty()) return {};
+    return {
+        {"x-amz-checksum-algorithm", ChecksumName(config.checksumAlgorithm)},
+        {"x-amz-checksum-type", "FULL_OBJECT"}};
+}
+
+WebClient BuildBeginUploadRequest(const Config& config, const string& endpoint,
+                                  const string& path) {
+    auto signedHeaders =
+        SignHeaders(config.s3AccessKey, config.s3SecretKey, endpoint, "POST",
+                    config.bucket, config.key, "", {{"uploads=", ""}},
+                    ChecksumTypeHeaders(config));
+    Headers headers(begin(signedHeaders), end(signedHeaders));
+    WebClient req(endpoint, path, "POST", {{"uploads=", ""}}, headers);
+    req.SetHTTPVersion(config.httpVersion);
+    return req;
+}
+
+// The full object checksum, when part checksums are given, is combined
+// from the checksums of the parts
 WebClient BuildEndUploadRequest(const Config& config, const string& path,
-                                vector<future<string>>& etags,
-                                const string& uploadId) {
+                                const vector<string>& etags,
+                                const string& uploadId,
+                                const vector<Checksum>* checksums) {
     Parameters params = {{"uploadId", uploadId}};
-    auto randomIndex = RandomRange(0, config.endpoints.size() - 1);
-    const string endpoint = config.endpoints[randomIndex()];
+    const string endpoint = SelectEndpoint(config);
+    Headers checksumHeaders;
+    if (checksums) {
+        Checksum object(config.checksumAlgorithm);
+        for (const Checksum& c : *checksums) object.Combine(c);
+        checksumHeaders = {
+            {ChecksumHeader(object.Algorithm()), object.Base64()},
+            {"x-amz-checksum-type", "FULL_OBJECT"}};
+    }
     auto signedHeaders =
         SignHeaders(config.s3AccessKey, config.s3SecretKey, endpoint, "POST",
-                    config.bucket, config.key, "", params);
+                    config.bucket, config.key, "", params, checksumHeaders);
     Headers headers(begin(signedHeaders), end(signedHeaders));
     WebClient req(endpoint, path, "POST", params, headers);
+    req.SetHTTPVersion(config.httpVersion);
     req.SetMethod("POST");
-    req.SetPostData(BuildEndUploadXML(etags));
+    req.SetPostData(BuildEndUploadXML(etags, checksums));
     return req;
 }
 
+// Abort multipart upload, parts already uploaded are deleted by the server
+void AbortUpload(const Config& config, const string& path,
+                 const string& uploadId) {
+    Parameters params = {{"uploadId", uploadId}};
+    auto signedHeaders =
+        SignHeaders(config.s3AccessKey, config.s3SecretKey, config.endpoint,
+                    "DELETE", config.bucket, config.key, "", params);
+    Headers headers(begin(signedHeaders), end(signedHeaders));
+    WebClient req(config.endpoint, path, "DELETE", params, headers);
+    req.SetHTTPVersion(config.httpVersion);
+    if (!req.Send() || req.StatusCode() >= 400) {
+        cerr << "Error aborting upload " << uploadId << endl;
+    }
+}
+
+// Initiate multipart upload and return upload id
+string BeginUpload(const Config& config, const string& endpoint,
+                   const string& path, int& retries) {
+    WebClient req = SendWithRetry(
+        config,
+        [&]() { return BuildBeginUploadRequest(config, endpoint, path); },
+        SendRequest, retries);
+    if (req.StatusCode() == 0) {
+        throw runtime_error("Error sending request: " + req.ErrorMsg());
+    }
+    if (req.StatusCode() >= 400) {
+        const string errcode = XMLTag(req.GetContentText(), "[Cc]ode");
+        throw runtime_error("Error sending begin upload request - " + errcode);
+    }
+    vector<uint8_t> resp = req.GetResponseBody();
+    const string xml(begin(resp), end(resp));
+    return XMLTag(xml, "[Uu]pload[Ii][dD]");
+}
+
+// Complete multipart upload and return etag of object, empty if not found;
+// \c checksums are the part checksums, \c nullptr if none
+string CompleteUpload(const Config& config, const string& path,
+                      const vector<string>& etags, const string& uploadId,
+                      int& retries,
+                      const vector<Checksum>* checksums = nullptr) {
+    // complete request can fail after a 200 status code was sent
+    WebClient endUpload = SendWithRetry(
+        config,
+        [&]() {
+            return BuildEndUploadRequest(config, path, etags, uploadId,
+                                         checksums);
+        },
+        SendRequest, retries, [](const WebClient& req) {
+            return !XMLTag(req.GetContentText(), "[Ee][Tt]ag").empty();
+        });
+    if (endUpload.StatusCode() == 0) {
+        throw runtime_error("Error sending request: " + endUpload.ErrorMsg());
+    }
+    if (endUpload.StatusCode() >= 400) {
+        const string errcode = XMLTag(endUpload.GetContentText(), "[Cc]ode");
+        throw runtime_error("Error sending end upload request - " + errcode);
+    }
+    return XMLTag(endUpload.GetContentText(), "[Ee][Tt]ag");
+}
+
+struct PartInfo {
+    string etag;
+    size_t size = 0;
+};
+
+// Return parts stored on the server: {part number, {etag, size}}; responses
+// contain at most 1000 parts, request next page until not truncated
+map<int, PartInfo> ListParts(const Config& config, const string& path,
+                             const string& uploadId) {
+    map<int, PartInfo> parts;
+    string marker;
+    while (true) {
+        Parameters params = {{"uploadId", uploadId}};
+        if (!marker.empty()) params["part-number-marker"] = marker;
+        int retries = 0;
+        WebClient req = SendWithRetry(
+            config,
+            [&]() {
+                auto signedHeaders = SignHeaders(
+                    config.s3AccessKey, config.s3SecretKey, config.endpoint,
+                    "GET", config.bucket, config.key, "", params);
+                Headers headers(begin(signedHeaders), end(signedHeaders));
+                WebClient req(config.endpoint, path, "GET", params, headers);
+                req.SetHTTPVersion(config.httpVersion);
+                return req;
+            },
+            SendRequest, retries);
+        if (req.StatusCode() == 0) {
+            throw runtime_error("Error sending request: " + req.ErrorMsg());
+        }
+        const string xml = req.GetContentText();
+        if (req.StatusCode() >= 400) {
+            throw runtime_error("Error sending list parts request - " +
+                                XMLTag(xml, "[Cc]ode"));
+        }
+        for (const auto& p : XMLElements(xml, "Part")) {
+            const int partNumber = stoi(XMLTag(p, "PartNumber"));
+            parts[partNumber] = {XMLTag(p, "ETag"), stoull(XMLTag(p, "Size"))};
+        }
+        if (XMLTag(xml, "IsTruncated") != "true") break;
+        marker = XMLTag(xml, "NextPartNumberMarker");
+        if (marker.empty()) break;
+    }
+    return parts;
+}
+
+// Remove quotes, escaped as &quot; in XML responses
+string UnquoteETag(const string& etag) {
+    return regex_replace(etag, regex("&quot;|\""), "");
+}
+
+// Reconcile journal with the parts stored on the server and return the
+// etags of the parts which do not need to be uploaded again, empty for
+// missing parts. The server is authoritative: journaled parts not found or
+// with a different etag are uploaded again, parts uploaded but not yet
+// journaled when the upload was interrupted are kept.
+vector<string> ResumeParts(const Config& config, const string& path,
+                           const UploadJournal& journal) {
+    const size_t fileSize = journal.FileSize();
+    const size_t partSize = journal.PartSize();
+    vector<string> etags((fileSize + partSize - 1) / partSize);
+    const map<int, PartInfo> stored =
+        ListParts(config, path, journal.UploadId());
+    const auto& journaled = journal.Parts();
+    for (const auto& kv : stored) {
+        const size_t i = kv.first - 1;
+        if (i >= etags.size()) continue;
+        const size_t offset = i * partSize;
+        if (kv.second.size != min(partSize, fileSize - offset)) continue;
+        const string etag = UnquoteETag(kv.second.etag);
+        auto j = journaled.find(kv.first);
+        if (j != journaled.end() && UnquoteETag(j->second) == etag) {
+            etags[i] = j->second;
+        } else {
+            etags[i] = "\"" + etag + "\"";
+        }
+    }
+    return etags;
+}
+
+bool HasETag(const WebClient& req) {
+    return !HTTPHeader(req.GetHeaderText(), "[Ee][Tt]ag").empty();
+}
+
+// Error message of failed part upload
+string PartError(const WebClient& req, size_t i) {
+    const string part = "Cannot upload part " + to_string(i + 1) + " - ";
+    if (req.StatusCode() >= 400) {
+        return part + "HTTP status " + to_string(req.StatusCode()) + " " +
+               XMLTag(req.GetContentText(), "[Cc]ode");
+    }
+    if (req.StatusCode() > 0) return part + "no ETag found in HTTP header";
+    return part + req.ErrorMsg();
+}
+
+// Record completion of part upload sent to endpoint; a part upload
+// cancelled because its duplicate completed first only releases its slot,
+// its duration is still a sample of the endpoint latency
+void EndPart(const Config& config, size_t e, const WebClient& req,
+             size_t bytes) {
+    EndpointSelector& selector = *config.selector;
+    const string& endpoint = selector.Endpoint(e);
+    if (req.Cancelled()) {
+        selector.End(e, RequestStatus::OK, req.TransferTime());
+    } else {
+        selector.End(e, RetryPolicy::Classify(req), req.TransferTime());
+        UpdateConcurrency(config, endpoint, req, bytes);
+    }
+    if (config.concurrency) config.concurrency->Release(endpoint);
+}
+
+// Build duplicate of slow part upload sent to a different endpoint than
+// \c e if possible; return nullptr when no buffer or concurrency slot is
+// available, so that the caller is never blocked
+unique_ptr<WebClient> BuildHedge(const Config& config, const string& path,
+                                 const string& uploadId, int i, size_t offset,
+                                 size_t chunkSize, size_t e, size_t& he,
+                                 const char* data = nullptr) {
+    EndpointSelector& selector = *config.selector;
+    BufferPool::Buffer buffer;
+    if (config.bufferPool && !data) {
+        buffer = config.bufferPool->TryAcquire();
+        if (!buffer) return nullptr;
+    }
+    he = selector.Select(e);
+    if (config.concurrency &&
+        !config.concurrency->TryAcquire(selector.Endpoint(he))) {
+        return nullptr;
+    }
+    selector.Begin(he);
+    unique_ptr<WebClient> req(new WebClient(BuildUploadRequest(
+        config, selector.Endpoint(he), path, i, uploadId, data, chunkSize)));
+    SetPartSource(config, *req, offset, chunkSize, data, move(buffer));
+    return req;
+}
+
+// Upload object with a single request, from the input file or from memory
+// when \c data is not null; return etag of object
+string PutObject(const Config& config, const string& endpoint,
+                 const string& path, size_t size, const char* data,
+                 int& retries) {
+    WebClient req = SendWithRetry(
+        config,
+        [&]() {
+            auto signedHeaders =
+                Chunked(config)
+                    ? SignStreamingHeaders(
+                          *config.signer, config.hosts.at(endpoint), "PUT",
+                          path, size, {}, Trailer(config), config.signChunks)
+                    : SignHeaders(config.s3AccessKey, config.s3SecretKey,
+                                  endpoint, "PUT", config.bucket, config.key,
+                                  PayloadHash(config, 0, data, size));
+            Map headers(begin(signedHeaders), end(signedHeaders));
+            WebClient req(endpoint, path, "PUT", {}, headers);
+            req.SetHTTPVersion(config.httpVersion);
+            return req;
+        },
+        [&](WebClient& req) {
+            SetPartSource(config, req, 0, size, data);
+            return req.Send();
+        },
+        retries, HasETag);
+    if (req.StatusCode() == 0) {
+        throw runtime_error("Error sending request: " + req.ErrorMsg());
+    }
+    if (req.StatusCode() >= 400) {
+        const string errcode = XMLTag(req.GetContentText(), "[Cc]ode");
+        throw runtime_error("Error sending upload request - " + errcode);
+    }
+    return HTTPHeader(req.GetHeaderText(), "[Ee][Tt]ag");
+}
+
+// Upload part from file region or, when \c data is not null, from memory;
+// the checksum of the part is stored into \c checksum if not null
 string UploadPart(const Config& config, const string& path,
                   const string& uploadId, int i, size_t offset,
-                  size_t chunkSize, int maxTries = 1, int tryNum = 1) {
-    WebClient ul = BuildUploadRequest(config, path, i, uploadId);
-    const bool ok = ul.UploadFile(config.file, offset, chunkSize);
-    if (!ok) {
-        throw(runtime_error("Cannot upload chunk " + to_string(i + 1)));
-    }
-    const string etag = HTTPHeader(ul.GetHeaderText(), "[Ee][Tt]ag");
-    if (etag.empty()) {
-        if (tryNum == maxTries) {
-            throw(runtime_error("No ETag found in HTTP header"));
-        } else {
-            numRetriesG += 1;
-            return UploadPart(config, path, uploadId, i, offset, chunkSize,
-                              maxTries, ++tryNum);
+                  size_t chunkSize, int& retries, const char* data = nullptr,
+                  Checksum* checksum = nullptr) {
+    EndpointSelector& selector = *config.selector;
+    size_t e = 0;  // endpoint of current attempt
+    WebClient ul = SendWithRetry(
+        config,
+        [&]() {
+            e = selector.Acquire();
+            return BuildUploadRequest(config, selector.Endpoint(e), path, i,
+                                      uploadId, data, chunkSize);
+        },
+        [&](WebClient& req) {
+            const string& endpoint = selector.Endpoint(e);
+            if (config.concurrency) config.concurrency->Acquire(endpoint);
+            SetPartSource(config, req, offset, chunkSize, data);
+            if (!config.hedge) {
+                const bool ok = req.Send();
+                EndPart(config, e, req, chunkSize);
+                return ok;
+            }
+            size_t he = 0;                   // endpoint of duplicate
+            const WebClient* dup = nullptr;  // duplicate while in flight
+            return SendHedged(
+                *config.hedge, chunkSize, req,
+                [&]() {
+                    unique_ptr<WebClient> h = BuildHedge(
+                        config, path, uploadId, i, offset, chunkSize, e, he,
+                        data);
+                    dup = h.get();
+                    return h;
+                },
+                [&](WebClient& r) {
+                    EndPart(config, &r == dup ? he : e, r, chunkSize);
+                });
+        },
+        retries, HasETag);
+    if (RetryPolicy::Classify(ul) != RequestStatus::OK || !HasETag(ul)) {
+        throw runtime_error(PartError(ul, i));
+    }
+    if (checksum) *checksum = PartChecksum(ul, i, chunkSize);
+    return HTTPHeader(ul.GetHeaderText(), "[Ee][Tt]ag");
+}
+
+// Return part size: either the one specified on the command line or the
+// file size divided by the number of jobs, within the part size limits
+size_t PartSize(const Config& config, size_t fileSize) {
+    if (!config.partSize.empty()) return ParseSize(config.partSize);
+    const size_t partSize = (fileSize + config.jobs - 1) / config.jobs;
+    return min(max(partSize, MIN_PART_SIZE), MAX_PART_SIZE);
+}
+
+// S3 rejects the completion of an upload with a part other than the last
+// smaller than the minimum part size: check before uploading any part
+void ValidatePartSize(size_t partSize, size_t fileSize) {
+    if (partSize == 0 || (partSize < MIN_PART_SIZE && partSize < fileSize) ||
+        partSize > MAX_PART_SIZE) {
+        throw invalid_argument("ERROR: part size must be in range [" +
+                               to_string(MIN_PART_SIZE) + ", " +
+                               to_string(MAX_PART_SIZE) +
+                               "] unless the file fits in one part");
+    }
+}
+
+// Upload parts through a fixed pool of workers: each worker pulls the next
+// part index from a shared counter until all the parts have been uploaded
+// or an error occurs, the first error is rethrown after all workers exit.
+// With event loops enabled each worker drives up to jobs / eventLoops
+// concurrent parts through a TransferEngine instead of one part at a time.
+// Parts with a non empty etag in \c etags are skipped, completed parts are
+// recorded into the journal if not null. Failed parts are retried according
+// to the retry policy, the number of retries of each part is stored into
+// \c retries. In adaptive mode the number of parts sent concurrently to
+// each endpoint is limited by the concurrency controller. When not null,
+// \c checksums receives the checksum of each part, skipped parts are read
+// again to compute it.
+vector<string> UploadParts(const Config& config, const string& path,
+                           const string& uploadId, size_t fileSize,
+                           size_t partSize, vector<string> etags,
+                           UploadJournal* journal, vector<int>& retries,
+                           vector<Checksum>* checksums = nullptr) {
+    const size_t numParts = etags.size();
+    if (checksums) {
+        checksums->assign(numParts, Checksum(config.checksumAlgorithm));
+        for (size_t i = 0; i != numParts; ++i) {
+            if (etags[i].empty()) continue;
+            const size_t offset = i * partSize;
+            (*checksums)[i] = FileChecksum(
+                config, offset, min(partSize, fileSize - offset));
         }
     }
-    return etag;
+    retries.assign(numParts, 0);
+    atomic<size_t> nextPart{0};
+    atomic<bool> failed{false};
+    exception_ptr error;
+    mutex errorMutex;
+    auto fail = [&](exception_ptr e) {
+        const lock_guard<mutex> lock(errorMutex);
+        if (!error) error = e;
+        failed = true;
+    };
+    // each index is claimed by a single worker, etags[i] is only written by
+    // the worker which claimed it
+    auto next = [&]() {
+        size_t i = nextPart++;
+        while (i < numParts && !etags[i].empty()) i = nextPart++;
+        return i;
+    };
+    auto record = [&](size_t i, const string& etag) {
+        etags[i] = etag;
+        if (journal) journal->AddPart(int(i + 1), etag);
+    };
+    auto worker = [&]() {
+        while (!failed) {
+            const size_t i = next();
+            if (i >= numParts) break;
+            const size_t offset = i * partSize;
+            const size_t sz = min(partSize, fileSize - offset);
+            try {
+                Checksum* checksum = checksums ? &(*checksums)[i] : nullptr;
+                record(i, UploadPart(config, path, uploadId, i, offset, sz,
+                                     retries[i], nullptr, checksum));
+            } catch (...) {
+                fail(current_exception());
+            }
+        }
+    };
+    auto eventLoop = [&]() {
+        const int inFlight =
+            (config.jobs + config.eventLoops - 1) / config.eventLoops;
+        TransferEngine engine(inFlight);
+        if (config.maxStreams > 0) {
+            engine.SetMaxConcurrentStreams(config.maxStreams);
+        }
+        engine.SetHedgePolicy(config.hedge.get());
+        using SourceStatus = TransferEngine::SourceStatus;
+        using Clock = chrono::steady_clock;
+        struct Part {
+            size_t i;   // part index
+            int retry;  // number of retries already performed
+        };
+        // parts to retry sorted by time they can be sent, they are signed
+        // again and sent to the endpoint selected at that time
+        multimap<Clock::time_point, Part> retryQueue;
+        // part waiting for a free slot in the concurrency window
+        Part pending{numParts, 0};
+        bool partsDone = false;
+        EndpointSelector& selector = *config.selector;
+        // completion of part upload or of its duplicate; the one cancelled
+        // or superseded by the other is only accounted for
+        auto partDone = [&](Part p, size_t e, size_t sz) {
+            return [&, p, e, sz](WebClient& ul, bool) {
+                EndPart(config, e, ul, sz);
+                if (ul.Cancelled()) return;
+                RequestStatus status = RetryPolicy::Classify(ul);
+                if (status == RequestStatus::OK && !HasETag(ul)) {
+                    status = RequestStatus::RETRY;
+                }
+                if (!failed && config.retryPolicy.Retry(status, p.retry)) {
+                    retries[p.i] += 1;
+                    retryQueue.insert(
+                        {Clock::now() + config.retryPolicy.Delay(p.retry),
+                         {p.i, p.retry + 1}});
+                } else if (status == RequestStatus::OK) {
+                    try {
+                        if (checksums) {
+                            (*checksums)[p.i] = PartChecksum(ul, p.i, sz);
+                        }
+                        record(p.i,
+                               HTTPHeader(ul.GetHeaderText(), "[Ee][Tt]ag"));
+                    } catch (...) {
+                        fail(current_exception());
+                    }
+                } else {
+                    fail(make_exception_ptr(runtime_error(PartError(ul, p.i))));
+                }
+            };
+        };
+        auto addPart = [&](Part p, size_t e, BufferPool::Buffer buffer) {
+            const string& endpoint = selector.Endpoint(e);
+            const size_t offset = p.i * partSize;
+            const size_t sz = min(partSize, fileSize - offset);
+            unique_ptr<WebClient> req(new WebClient(BuildUploadRequest(
+                config, endpoint, path, p.i, uploadId, nullptr, sz)));
+            SetPartSource(config, *req, offset, sz, nullptr, move(buffer));
+            engine.AddHedged(
+                move(req), partDone(p, e, sz), sz,
+                [&, p, e, offset, sz](TransferEngine::Completion& done) {
+                    size_t he = 0;
+                    unique_ptr<WebClient> h = BuildHedge(
+                        config, path, uploadId, p.i, offset, sz, e, he);
+                    if (h) done = partDone(p, he, sz);
+                    return h;
+                });
+        };
+        try {
+            engine.Run([&](TransferEngine&) {
+                if (failed) return SourceStatus::DONE;
+                if (pending.i >= numParts) {
+                    auto r = retryQueue.begin();
+                    if (r != retryQueue.end() && r->first <= Clock::now()) {
+                        pending = r->second;
+                        retryQueue.erase(r);
+                    } else if (!partsDone) {
+                        pending = {next(), 0};
+                        partsDone = pending.i >= numParts;
+                    }
+                }
+                if (pending.i >= numParts) {
+                    // in-flight parts can still be queued for retry
+                    return retryQueue.empty() && engine.InFlight() == 0
+                               ? SourceStatus::DONE
+                               : SourceStatus::WAIT;
+                }
+                // do not block the event loop when memory budget is used up
+                BufferPool::Buffer buffer;
+                if (config.bufferPool) {
+                    buffer = config.bufferPool->TryAcquire();
+                    if (!buffer) return SourceStatus::WAIT;
+                }
+                const size_t e = selector.Select();
+                if (config.concurrency &&
+                    !config.concurrency->TryAcquire(selector.Endpoint(e))) {
+                    return SourceStatus::WAIT;
+                }
+                selector.Begin(e);
+                addPart(pending, e, move(buffer));
+                pending = {numParts, 0};
+                return SourceStatus::ADDED;
+            });
+        } catch (...) {
+            fail(current_exception());
+        }
+    };
+    vector<thread> workers;
+    if (config.eventLoops > 0) {
+        for (int w = 0; w != config.eventLoops; ++w) {
+            workers.push_back(thread(eventLoop));
+        }
+    } else {
+        const size_t numWorkers = min(size_t(config.jobs), numParts);
+        for (size_t w = 0; w != numWorkers; ++w) {
+            workers.push_back(thread(worker));
+        }
+    }
+    for (auto& w : workers) w.join();
+    if (error) rethrow_exception(error);
+    return etags;
+}
+
+// Print number of retries and of hedged parts
+void PrintStats(const Config& config, int numRetries,
+                const vector<int>& partRetries) {
+    for (int r : partRetries) numRetries += r;
+    if (numRetries > 0) {
+        cout << "Num retries: " << numRetries << endl;
+        for (size_t i = 0; i != partRetries.size(); ++i) {
+            if (partRetries[i] == 0) continue;
+            cout << "  part " << (i + 1) << ": " << partRetries[i] << endl;
+        }
+    }
+    if (config.hedge && config.hedge->Hedges() > 0) {
+        cout << "Num hedged parts: " << config.hedge->Hedges() << endl;
+    }
+}
+
+// Read until size bytes are read or input ends, return bytes read
+size_t ReadFull(int fd, char* data, size_t size) {
+    size_t n = 0;
+    while (n < size) {
+        const ssize_t r = read(fd, data + n, size - n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) {
+            throw runtime_error(string("Error reading input: ") +
+                                strerror(errno));
+        }
+        if (r == 0) break;
+        n += size_t(r);
+    }
+    return n;
+}
+
+// Upload standard input, return etag of object. Parts are read into a pool
+// of jobs + 1 buffers and uploaded from memory by jobs threads while the
+// next part is read; reading waits for a buffer to be released, so that
+// memory stays at about (jobs + 1) x part size. Input smaller than one part
+// is sent with a single request.
+string UploadStream(const Config& config, const string& path,
+                    size_t partSize, vector<int>& retries, int& numRetries) {
+    BufferPool pool(partSize, (config.jobs + 1) * partSize, config.hugePages);
+    struct Part {
+        size_t i;  // part index
+        BufferPool::Buffer buffer;
+        size_t size;
+    };
+    Part first{0, pool.Acquire(), 0};
+    first.size = ReadFull(STDIN_FILENO, first.buffer.Data(), partSize);
+    const string endpoint = SelectEndpoint(config);
+    if (first.size < partSize) {
+        return UnquoteETag(PutObject(config, endpoint, path, first.size,
+                                     first.buffer.Data(), numRetries));
+    }
+    const string uploadId = BeginUpload(config, endpoint, path, numRetries);
+    // number of parts is only known at the end of input
+    vector<string> etags(MAX_NUM_PARTS);
+    vector<Checksum> checksums(config.checksum.empty() ? 0 : MAX_NUM_PARTS,
+                               Checksum(config.checksumAlgorithm));
+    retries.assign(MAX_NUM_PARTS, 0);
+    deque<Part> queue;  // parts read and not uploaded yet
+    bool inputDone = false;
+    mutex queueMutex;
+    condition_variable queued;
+    atomic<bool> failed{false};
+    exception_ptr error;
+    auto fail = [&](exception_ptr e) {
+        const lock_guard<mutex> lock(queueMutex);
+        if (!error) error = e;
+        failed = true;
+    };
+    // after a failure parts are only released, so that reading stops
+    auto worker = [&]() {
+        while (true) {
+            Part p;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queued.wait(lock, [&] { return inputDone || !queue.empty(); });
+                if (queue.empty()) break;
+                p = move(queue.front());
+                queue.pop_front();
+            }
+            if (failed) continue;
+            try {
+                Checksum* checksum =
+                    checksums.empty() ? nullptr : &checksums[p.i];
+                etags[p.i] =
+                    UploadPart(config, path, uploadId, int(p.i), 0, p.size,
+                               retries[p.i], p.buffer.Data(), checksum);
+            } catch (...) {
+                fail(current_exception());
+            }
+        }
+    };
+    vector<thread> workers;
+    for (int w = 0; w != config.jobs; ++w) workers.push_back(thread(worker));
+    size_t numParts = 0;
+    try {
+        for (Part p = move(first); !failed; p = {numParts, pool.Acquire(), 0}) {
+            if (p.i > 0) {
+                p.size = ReadFull(STDIN_FILENO, p.buffer.Data(), partSize);
+                if (p.size == 0) break;
+                if (p.i >= MAX_NUM_PARTS) {
+                    throw runtime_error(
+                        "ERROR: number of parts greater than " +
+                        to_string(MAX_NUM_PARTS) + ", increase part size");
+                }
+            }
+            const bool last = p.size < partSize;
+            {
+                const lock_guard<mutex> lock(queueMutex);
+                queue.push_back(move(p));
+            }
+            queued.notify_one();
+            ++numParts;
+            if (last) break;
+        }
+    } catch (...) {
+        fail(current_exception());
+    }
+    {
+        const lock_guard<mutex> lock(queueMutex);
+        inputDone = true;
+    }
+    queued.notify_all();
+    for (auto& w : workers) w.join();
+    etags.resize(numParts);
+    retries.resize(numParts);
+    if (!checksums.empty()) checksums.resize(numParts);
+    try {
+        if (error) rethrow_exception(error);
+        return CompleteUpload(config, path, etags, uploadId, numRetries,
+                              checksums.empty() ? nullptr : &checksums);
+    } catch (...) {
+        AbortUpload(config, path, uploadId);
+        throw;
+    }
 }
 
 void InitConfig(Config& config) {
@@ -229,6 +1138,34 @@ void InitConfig(Config& config) {
     if (config.endpoints.empty())
         throw invalid_argument("Error, no endpoints specified");
     config.endpoint = config.endpoints[0];
+    for (const auto& e : config.endpoints) config.hosts[e] = HostHeader(e);
+    config.signer.reset(
+        new SigV4Signer(config.s3AccessKey, config.s3SecretKey));
+    if (!config.readAhead.empty()) {
+        config.readAheadSize = ParseSize(config.readAhead);
+    }
+    config.selector.reset(new EndpointSelector(
+        config.endpoints, chrono::seconds(config.cooldown)));
+    config.httpVersion = ParseHTTPVersion(config.http);
+    if (!config.checksum.empty()) {
+        config.checksumAlgorithm = ParseChecksumAlgorithm(config.checksum);
+    }
+    config.retryPolicy = RetryPolicy(
+        config.maxRetries, RetryPolicy::Duration(config.retryDelay));
+    if (config.adaptive) {
+        config.concurrency.reset(new ConcurrencyController(config.jobs));
+    }
+    if (config.hedgeBudget > 0) {
+        config.hedge.reset(new HedgePolicy(config.hedgeBudget));
+    }
+    if (config.direct && !config.ioURing) {
+        // one buffer per job unless a budget is given
+        const size_t budget = config.bufferMemory.empty()
+                                  ? SliceSize(config) * config.jobs
+                                  : ParseSize(config.bufferMemory);
+        config.bufferPool.reset(
+            new BufferPool(SliceSize(config), budget, config.hugePages));
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -250,11 +1187,80 @@ int main(int argc, char const* argv[]) {
             lyra::opt(config.bucket, "bucket")["-b"]["--bucket"]("Bucket name")
                 .required() |
             lyra::opt(config.key, "key")["-k"]["--key"]("Key name").required() |
-            lyra::opt(config.file, "file")["-f"]["--file"]("File name")
-                .required() |
+            lyra::opt(config.file, "file")["-f"]["--file"](
+                "File name, '-' for standard input")
+                .optional() |
+            lyra::opt(config.fromStdin)["--stdin"](
+                "Upload standard input, e.g. the output of another program; "
+                "parts are buffered in memory, (jobs + 1) x part size")
+                .optional() |
             lyra::opt(config.jobs, "parallel jobs")["-j"]["--jobs"](
                 "Number parallel upload jobs")
                 .optional() |
+            lyra::opt(config.partSize, "part size")["-P"]["--part-size"](
+                "Multipart part size, e.g. 64M, at least 5 MiB unless the "
+                "file fits in one part; default: file size / jobs, 64 MiB "
+                "with --stdin")
+                .optional() |
+            lyra::opt(config.eventLoops, "event loops")["-E"]["--event-loops"](
+                "Number of threads driving parts through curl_multi event "
+                "loops, 0 = one thread per job")
+                .optional() |
+            lyra::opt(config.http, "HTTP version")["--http"](
+                "HTTP version: 1.1 | 2 | h2c (HTTP/2 prior knowledge); "
+                "parts are multiplexed over HTTP/2 with --event-loops")
+                .optional() |
+            lyra::opt(config.maxStreams, "max streams")["--max-streams"](
+                "Max number of concurrent HTTP/2 streams per connection")
+                .optional() |
+            lyra::opt(config.adaptive)["--adaptive"](
+                "Adapt number of concurrent parts per endpoint to throughput "
+                "and throttling, up to the number of jobs")
+                .optional() |
+            lyra::opt(config.readAhead, "slice size")["--read-ahead"](
+                "Read each part in slices of this size, e.g. 4M, on "
+                "background threads while the previous slice is sent")
+                .optional() |
+            lyra::opt(config.ioURing)["--io-uring"](
+                "Read parts through io_uring, in slices of --read-ahead "
+                "size or 1 MiB")
+                .optional() |
+            lyra::opt(config.direct)["--direct"](
+                "Bypass page cache (O_DIRECT); without --io-uring parts are "
+                "read into reusable buffers of --read-ahead size or 1 MiB")
+                .optional() |
+            lyra::opt(config.bufferMemory, "size")["--buffer-memory"](
+                "Max memory used by --direct buffers, e.g. 1G; parts wait "
+                "for a free buffer; default: one buffer per job")
+                .optional() |
+            lyra::opt(config.hugePages)["--huge-pages"](
+                "Allocate --direct buffers from huge pages")
+                .optional() |
+            lyra::opt(config.hedgeBudget, "ratio")["--hedge"](
+                "Send a duplicate of parts slower than the 95th percentile "
+                "to another endpoint, cancelling the slower one; max ratio "
+                "of duplicates to parts, e.g. 0.05; default: disabled")
+                .optional() |
+            lyra::opt(config.cooldown, "seconds")["--endpoint-cooldown"](
+                "Time a failing endpoint is taken out of rotation")
+                .optional() |
+            lyra::opt(config.signPayload)["--sign-payload"](
+                "Sign SHA-256 of part payloads instead of sending them "
+                "unsigned; file parts are read one more time to hash them")
+                .optional() |
+            lyra::opt(config.signChunks)["--sign-chunks"](
+                "Sign payloads chunk by chunk while they are sent "
+                "(aws-chunked encoding), reading data once")
+                .optional() |
+            lyra::opt(config.checksum, "algorithm")["--checksum"](
+                "Send CRC32C or CRC64NVME checksum of parts computed while "
+                "they are sent, combined into the full object checksum: "
+                "crc32c | crc64nvme")
+                .optional() |
+            lyra::opt(config.journal, "journal file")["--resume"](
+                "Journal file recording upload id and completed parts; "
+                "if the file exists the upload is resumed")
+                .optional() |
             lyra::opt(config.credentials,
                       "credentials file")["-c"]["--credentials"](
                 "Credentials file, AWS cli format")
@@ -264,7 +1270,11 @@ int main(int argc, char const* argv[]) {
                 "Profile in AWS config file")
                 .optional() |
             lyra::opt(config.maxRetries, "Max retries")["-r"]["--retries"](
-                "Max number of per-multipart part retries")
+                "Max number of retries per request, transient errors only")
+                .optional() |
+            lyra::opt(config.retryDelay, "retry delay")["--retry-delay"](
+                "Base retry delay in milliseconds, doubled at each retry and "
+                "randomized")
                 .optional();
 
         // Parse the program arguments:
@@ -281,95 +1291,132 @@ int main(int argc, char const* argv[]) {
             return 0;
         }
         Validate(config);
+        if (config.fromStdin || config.file == "-") {
+            const size_t partSize = config.partSize.empty()
+                                        ? size_t(64) << 20
+                                        : ParseSize(config.partSize);
+            // stream size is not known in advance
+            ValidatePartSize(partSize, numeric_limits<size_t>::max());
+            int numRetries = 0;
+            vector<int> partRetries;
+            const string etag =
+                UploadStream(config, "/" + config.bucket + "/" + config.key,
+                             partSize, partRetries, numRetries);
+            if (etag.empty()) {
+                cerr << "Error sending upload request" << endl;
+            }
+            cout << etag << endl;
+            PrintStats(config, numRetries, partRetries);
+            return 0;
+        }
         FILE* inputFile = fopen(config.file.c_str(), "rb");
         if (!inputFile) {
             throw runtime_error(string("cannot open file ") + config.file);
         }
+        // modification time and inode identify the file in the journal
+        struct stat st;
+        const bool statOk = fstat(fileno(inputFile), &st) == 0;
         fclose(inputFile);
+        if (!statOk) {
+            throw runtime_error("cannot read attributes of file " +
+                                config.file + ": " + strerror(errno));
+        }
+        const uint64_t fileTime =
+            uint64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        const uint64_t fileInode = st.st_ino;
         string path = "/" + config.bucket + "/" + config.key;
-        auto randomIndex = RandomRange(0, config.endpoints.size() - 1);
-        const string endpoint = config.endpoints[randomIndex()];
-        if (config.jobs > 1) {
-            // retrieve file size
-            const size_t fileSize = FileSize(config.file);
-            // compute chunk size
-            const size_t chunkSize = fileSize / config.jobs;
-            // compute last chunk size
-            const size_t lastChunkSize =
-                fileSize % config.jobs == 0
-                    ? chunkSize
-                    : fileSize % config.jobs + chunkSize;
-            // initiate request
-            auto signedHeaders = SignHeaders(
-                config.s3AccessKey, config.s3SecretKey, endpoint, "POST",
-                config.bucket, config.key, "", {{"uploads=", ""}});
-            Map headers(begin(signedHeaders),
-                                        end(signedHeaders));
-            WebClient req(endpoint, path, "POST", {{"uploads=", ""}}, headers);
-            if (!req.Send()) {
-                throw runtime_error("Error sending request: " + req.ErrorMsg());
+        const string endpoint = SelectEndpoint(config);
+        // retrieve file size
+        const size_t fileSize = FileSize(config.file);
+        unique_ptr<UploadJournal> journal;
+        if (!config.journal.empty()) {
+            journal.reset(new UploadJournal(config.journal));
+            if (journal->HasUpload() &&
+                (journal->Bucket() != config.bucket ||
+                 journal->Key() != config.key)) {
+                throw invalid_argument("ERROR: journal " + config.journal +
+                                       " refers to a different upload");
             }
-            if (req.StatusCode() >= 400) {
-                const string errcode = XMLTag(req.GetContentText(), "[Cc]ode");
-                throw runtime_error("Error sending begin upload request - " +
-                                    errcode);
+            if (journal->HasUpload() &&
+                (journal->FileSize() != fileSize ||
+                 journal->FileTime() != fileTime ||
+                 journal->FileInode() != fileInode)) {
+                throw runtime_error(
+                    "ERROR: file changed since upload started, remove "
+                    "journal " +
+                    config.journal + " to upload it again");
+            }
+        }
+        // compute part size, when resuming use the one in the journal
+        const size_t partSize = journal && journal->HasUpload()
+                                    ? journal->PartSize()
+                                    : PartSize(config, fileSize);
+        ValidatePartSize(partSize, fileSize);
+        if ((fileSize + partSize - 1) / partSize > MAX_NUM_PARTS) {
+            throw invalid_argument(
+                "ERROR: number of parts greater than " +
+                to_string(MAX_NUM_PARTS) + ", increase part size");
+        }
+        if (config.signPayload) {
+            config.partHashes.reset(
+                new PartHasher(config.file, fileSize, partSize));
+        }
+        int numRetries = 0;       // retries of requests other than parts
+        vector<int> partRetries;  // retries of each part
+        if (fileSize > partSize) {
+            string uploadId;
+            vector<string> etags((fileSize + partSize - 1) / partSize);
+            vector<Checksum> checksums;
+            vector<Checksum>* partChecksums =
+                config.checksum.empty() ? nullptr : &checksums;
+            if (journal && journal->HasUpload()) {
+                uploadId = journal->UploadId();
+                etags = ResumeParts(config, path, *journal);
+            } else {
+                uploadId = BeginUpload(config, endpoint, path, numRetries);
+                if (journal) {
+                    journal->Begin(uploadId, config.bucket, config.key,
+                                   fileSize, partSize, fileTime, fileInode);
+                }
             }
-            vector<uint8_t> resp = req.GetResponseBody();
-            const string xml(begin(resp), end(resp));
-            const string uploadId = XMLTag(xml, "[Uu]pload[Ii][dD]");
-            vector<future<string>> etags(config.jobs);
 #ifdef TIME_UPLOAD
             using Clock = chrono::high_resolution_clock;
             auto start = Clock::now();
 #endif
-            for (int i = 0; i != config.jobs; ++i) {
-                const size_t sz =
-                    i != config.jobs - 1 ? chunkSize : lastChunkSize;
-                etags[i] =
-                    async(launch::async, UploadPart, config, path, uploadId, i,
-                          chunkSize * i, sz, config.maxRetries, 1);
-            }
-            WebClient endUpload =
-                BuildEndUploadRequest(config, path, etags, uploadId);
+            string etag;
+            try {
+                etags = UploadParts(config, path, uploadId, fileSize, partSize,
+                                    etags, journal.get(), partRetries,
+                                    partChecksums);
+                etag = CompleteUpload(config, path, etags, uploadId,
+                                      numRetries, partChecksums);
 #ifdef TIME_UPLOAD
-            const auto end = Clock::now();
-            const double elapsed =
-                double(chrono::duration_cast<chrono::nanoseconds>(end - start)
-                           .count()) /
-                1E9;
-            cout << "Elapsed: " << elapsed << " s" << endl;
+                const auto end = Clock::now();
+                const double elapsed =
+                    double(chrono::duration_cast<chrono::nanoseconds>(
+                               end - start)
+                               .count()) /
+                    1E9;
+                cout << "Elapsed: " << elapsed << " s" << endl;
 #endif
-            if (!endUpload.Send()) {
-                throw runtime_error("Error sending request: " + req.ErrorMsg());
+            } catch (...) {
+                // keep uploaded parts only if the upload can be resumed
+                if (journal) {
+                    cerr << "Upload interrupted, run again with --resume "
+                         << config.journal << " to resume" << endl;
+                } else {
+                    AbortUpload(config, path, uploadId);
+                }
+                throw;
             }
-            if (endUpload.StatusCode() >= 400) {
-                const string errcode =
-                    XMLTag(endUpload.GetContentText(), "[Cc]ode");
-                throw runtime_error("Error sending end upload request - " +
-                                    errcode);
-            }
-            const string etag =
-                XMLTag(endUpload.GetContentText(), "[Ee][Tt]ag");
+            if (journal) journal->Remove();
             if (etag.empty()) {
                 cerr << "Error sending end upload request" << endl;
             }
             cout << etag << endl;
         } else {
-            auto signedHeaders =
-                SignHeaders(config.s3AccessKey, config.s3SecretKey, endpoint,
-                            "PUT", config.bucket, config.key, "");
-            Map headers(begin(signedHeaders),
-                                        end(signedHeaders));
-            WebClient req(config.endpoint, path, "PUT", {}, headers);
-            if (!req.UploadFile(config.file)) {
-                throw runtime_error("Error sending request: " + req.ErrorMsg());
-            }
-            if (req.StatusCode() >= 400) {
-                const string errcode = XMLTag(req.GetContentText(), "[Cc]ode");
-                throw runtime_error("Error sending upload request - " +
-                                    errcode);
-            }
-            const string etag = HTTPHeader(req.GetHeaderText(), "[Ee][Tt]ag");
+            const string etag =
+                PutObject(config, endpoint, path, fileSize, nullptr, numRetries);
             if (etag[0] == '"') {
                 cout << etag.substr(1, etag.size() - 2) << endl;
             } else {
@@ -378,8 +1425,9 @@ int main(int argc, char const* argv[]) {
             if (etag.empty()) {
                 throw runtime_error("Error sending upload request");
             }
+            if (journal) journal->Remove();
         }
-        if (numRetriesG > 0) cout << "Num retries: " << numRetriesG << endl;
+        PrintStats(config, numRetries, partRetries);
         return 0;
     } catch (const exception& e) {
         cerr << e.what() << endl;
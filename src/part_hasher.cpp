@@ -0,0 +1,124 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file part_hasher.cpp
+ * \brief implementation of PartHasher class
+ */
+
+#include "part_hasher.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace sss {
+
+using namespace std;
+
+// public:
+PartHasher::PartHasher(const string& file, size_t fileSize, size_t partSize)
+    : file_(file),
+      fileSize_(fileSize),
+      partSize_(partSize),
+      groupSize_(strcmp(Sha256MultiBuffer::Backend(), "avx2-x8") == 0
+                     ? GROUP_SIZE
+                     : 1) {
+    if (partSize_ == 0) throw invalid_argument("Part size cannot be zero");
+    const size_t numParts = max((fileSize_ + partSize_ - 1) / partSize_,
+                                size_t(1));
+    groups_.reset(new Group[(numParts + groupSize_ - 1) / groupSize_]);
+}
+
+const string& PartHasher::Hash(size_t part) {
+    Group& g = groups_[part / groupSize_];
+    // an exception leaves the flag unset, the next caller tries again
+    call_once(g.hashed, &PartHasher::HashGroup, this, part / groupSize_);
+    return g.hashes[part % groupSize_];
+}
+
+// private:
+void PartHasher::HashGroup(size_t group) {
+    const int fd = open(file_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open file " + file_ + ": " +
+                            strerror(errno));
+    }
+    vector<char> buffer(groupSize_ * CHUNK_SIZE);
+    Sha256MultiBuffer sha;
+    // lanes past the group size are left empty
+    size_t offsets[GROUP_SIZE] = {0};
+    size_t ends[GROUP_SIZE] = {0};
+    for (size_t l = 0; l != groupSize_; ++l) {
+        const size_t begin = (group * groupSize_ + l) * partSize_;
+        offsets[l] = min(begin, fileSize_);
+        ends[l] = min(begin + partSize_, fileSize_);
+    }
+    bool done = false;
+    while (!done) {
+        const void* data[GROUP_SIZE] = {nullptr};
+        size_t sizes[GROUP_SIZE] = {0};
+        done = true;
+        for (size_t l = 0; l != groupSize_; ++l) {
+            char* p = buffer.data() + l * CHUNK_SIZE;
+            const size_t size = min(CHUNK_SIZE, ends[l] - offsets[l]);
+            size_t n = 0;
+            while (n < size) {
+                const ssize_t r =
+                    pread(fd, p + n, size - n, off_t(offsets[l] + n));
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) {
+                    const string err = r < 0 ? strerror(errno) : "end of file";
+                    close(fd);
+                    throw runtime_error("Error reading file " + file_ + ": " +
+                                        err);
+                }
+                n += size_t(r);
+            }
+            data[l] = p;
+            sizes[l] = size;
+            offsets[l] += size;
+            done = done && offsets[l] == ends[l];
+        }
+        sha.Add(data, sizes);
+    }
+    close(fd);
+    Group& g = groups_[group];
+    for (size_t l = 0; l != groupSize_; ++l) g.hashes[l] = sha.HexHash(l);
+}
+
+}  // namespace sss
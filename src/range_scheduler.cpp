@@ -0,0 +1,151 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file range_scheduler.cpp
+ * \brief implementation of RangeScheduler class
+ */
+
+#include "range_scheduler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace sss {
+
+using namespace std;
+
+// public:
+RangeScheduler::RangeScheduler(size_t size, size_t rangeSize, int numWorkers,
+                               size_t minSplit)
+    : minSplit_(minSplit) {
+    Init({{0, size}}, rangeSize, numWorkers);
+}
+RangeScheduler::RangeScheduler(const vector<Range>& ranges, size_t rangeSize,
+                               int numWorkers, size_t minSplit)
+    : minSplit_(minSplit) {
+    Init(ranges, rangeSize, numWorkers);
+}
+bool RangeScheduler::Next(int worker, Range& range) {
+    const lock_guard<mutex> lock(mutex_);
+    Worker& w = *workers_[worker];
+    if (!w.queue.empty()) {
+        range = w.queue.front();
+        w.queue.pop_front();
+    } else if (!Steal(range) && !Split(range)) {
+        return false;
+    }
+    w.pos = range.begin;
+    w.end = range.end;
+    return true;
+}
+// Only the owner updates pos, end is moved back by Split; bytes received
+// by the owner past a new end are also written by the new owner, with the
+// same content
+size_t RangeScheduler::Advance(int worker, size_t n) {
+    Worker& w = *workers_[worker];
+    const size_t pos = w.pos.load(memory_order_relaxed);
+    const size_t end = w.end.load(memory_order_acquire);
+    const size_t accepted = end > pos ? min(n, end - pos) : 0;
+    w.pos.store(pos + accepted, memory_order_relaxed);
+    return accepted;
+}
+RangeScheduler::Range RangeScheduler::Remaining(int worker) const {
+    const lock_guard<mutex> lock(mutex_);
+    const Worker& w = *workers_[worker];
+    return {w.pos.load(memory_order_relaxed), w.end.load(memory_order_relaxed)};
+}
+size_t RangeScheduler::Complete(int worker) {
+    const lock_guard<mutex> lock(mutex_);
+    Worker& w = *workers_[worker];
+    const size_t end = w.end.load(memory_order_relaxed);
+    w.end.store(w.pos.load(memory_order_relaxed), memory_order_release);
+    return end;
+}
+
+// private:
+// Split ranges and assign contiguous blocks to workers, so that each worker
+// reads sequentially
+void RangeScheduler::Init(const vector<Range>& ranges, size_t rangeSize,
+                          int numWorkers) {
+    if (numWorkers < 1) throw invalid_argument("Invalid number of workers");
+    if (rangeSize == 0) throw invalid_argument("Invalid range size");
+    for (int w = 0; w != numWorkers; ++w) {
+        workers_.push_back(unique_ptr<Worker>(new Worker));
+    }
+    vector<Range> split;
+    for (const Range& r : ranges) {
+        for (size_t b = r.begin; b < r.end; b += rangeSize) {
+            split.push_back({b, min(b + rangeSize, r.end)});
+        }
+    }
+    numRanges_ = split.size();
+    const size_t perWorker = (numRanges_ + numWorkers - 1) / numWorkers;
+    for (size_t r = 0; r != numRanges_; ++r) {
+        workers_[r / perWorker]->queue.push_back(split[r]);
+    }
+}
+// Take last range from longest queue
+bool RangeScheduler::Steal(Range& range) {
+    Worker* victim = nullptr;
+    for (auto& w : workers_) {
+        if (!w->queue.empty() &&
+            (!victim || w->queue.size() > victim->queue.size())) {
+            victim = w.get();
+        }
+    }
+    if (!victim) return false;
+    range = victim->queue.back();
+    victim->queue.pop_back();
+    return true;
+}
+// Take second half of the largest unfinished range
+bool RangeScheduler::Split(Range& range) {
+    if (minSplit_ == 0) return false;
+    Worker* victim = nullptr;
+    size_t remaining = 0;
+    for (auto& w : workers_) {
+        const size_t pos = w->pos.load(memory_order_relaxed);
+        const size_t end = w->end.load(memory_order_relaxed);
+        if (end > pos && end - pos > remaining) {
+            victim = w.get();
+            remaining = end - pos;
+        }
+    }
+    if (remaining < 2 * minSplit_) return false;
+    const size_t end = victim->end.load(memory_order_relaxed);
+    range = {end - remaining / 2, end};
+    victim->end.store(range.begin, memory_order_release);
+    return true;
+}
+
+}  // namespace sss
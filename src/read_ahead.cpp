@@ -0,0 +1,187 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file read_ahead.cpp
+ * \brief implementation of ReadAhead class
+ */
+
+#include "read_ahead.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace sss {
+
+using namespace std;
+
+namespace {
+
+const size_t ALIGNMENT = 4096;
+int numThreadsG = 4;
+
+// Fixed pool of threads executing read tasks, created on first use
+class IOPool {
+   public:
+    static IOPool& Instance() {
+        static IOPool pool(numThreadsG);
+        return pool;
+    }
+    void Submit(function<void()> task) {
+        {
+            const lock_guard<mutex> lock(mutex_);
+            tasks_.push(move(task));
+        }
+        cv_.notify_one();
+    }
+    ~IOPool() {
+        {
+            const lock_guard<mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+   private:
+    explicit IOPool(int n) {
+        for (int i = 0; i < max(n, 1); ++i) {
+            threads_.push_back(thread([this]() { Run(); }));
+        }
+    }
+    void Run() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;
+                task = move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+
+   private:
+    mutex mutex_;
+    condition_variable cv_;
+    queue<function<void()>> tasks_;
+    vector<thread> threads_;
+    bool stop_ = false;
+};
+
+// Read until size bytes are read or end of file, return -1 on error
+ssize_t ReadFully(int fd, char* buf, size_t size, size_t offset) {
+    size_t total = 0;
+    while (total < size) {
+        const ssize_t r = pread(fd, buf + total, size - total, offset + total);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return -1;
+        if (r == 0) break;
+        total += size_t(r);
+    }
+    return ssize_t(total);
+}
+
+}  // namespace
+
+// public:
+ReadAhead::ReadAhead(const string& fname, size_t offset, size_t size,
+                     size_t sliceSize)
+    : sliceSize_(max(sliceSize, ALIGNMENT)),
+      nextOffset_(offset),
+      end_(offset + size) {
+    fd_ = open(fname.c_str(), O_RDONLY | O_LARGEFILE);
+    if (fd_ < 0) {
+        throw runtime_error("Cannot open file " + fname + ": " +
+                            strerror(errno));
+    }
+    for (auto& b : buffers_) {
+        if (posix_memalign((void**)&b, ALIGNMENT, sliceSize_)) {
+            b = nullptr;
+            for (auto& p : buffers_) free(p);
+            close(fd_);
+            throw bad_alloc();
+        }
+    }
+    Schedule(0);
+}
+ReadAhead::~ReadAhead() {
+    if (pending_.valid()) pending_.wait();
+    for (auto& b : buffers_) free(b);
+    if (fd_ >= 0) close(fd_);
+}
+// When the current slice is consumed wait for the next one and start reading
+// the following one into the buffer just released
+ssize_t ReadAhead::Read(char* ptr, size_t size) {
+    if (pos_ == length_) {
+        if (!pending_.valid()) return 0;
+        const ssize_t r = pending_.get();
+        if (r < 0) return -1;
+        current_ = 1 - current_;
+        pos_ = 0;
+        length_ = size_t(r);
+        if (length_ == 0) return 0;
+        Schedule(1 - current_);
+    }
+    const size_t n = min(size, length_ - pos_);
+    memcpy(ptr, buffers_[current_] + pos_, n);
+    pos_ += n;
+    return ssize_t(n);
+}
+void ReadAhead::SetNumThreads(int n) { numThreadsG = n; }
+
+// private:
+// Submit read of next slice into buffer
+void ReadAhead::Schedule(int buffer) {
+    if (nextOffset_ >= end_) return;
+    const size_t size = min(sliceSize_, end_ - nextOffset_);
+    auto task = make_shared<packaged_task<ssize_t()>>(
+        bind(ReadFully, fd_, buffers_[buffer], size, nextOffset_));
+    pending_ = task->get_future();
+    nextOffset_ += size;
+    IOPool::Instance().Submit([task]() { (*task)(); });
+}
+
+}  // namespace sss
@@ -0,0 +1,142 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file reorder_buffer.cpp
+ * \brief implementation of ReorderBuffer class
+ */
+
+#include "reorder_buffer.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace sss {
+
+using namespace std;
+
+// public:
+ReorderBuffer::ReorderBuffer(int fd, size_t capacity)
+    : fd_(fd), capacity_(capacity) {
+    if (capacity == 0) throw invalid_argument("Invalid buffer capacity");
+    data_.reset(new char[capacity]);
+}
+bool ReorderBuffer::Reserve(size_t begin, size_t end) {
+    if (end - begin > capacity_) throw invalid_argument("Range too large");
+    unique_lock<mutex> lock(mutex_);
+    space_.wait(lock, [&] { return aborted_ || Fits(end); });
+    return !aborted_;
+}
+bool ReorderBuffer::TryReserve(size_t begin, size_t end) {
+    if (end - begin > capacity_) throw invalid_argument("Range too large");
+    const lock_guard<mutex> lock(mutex_);
+    return !aborted_ && Fits(end);
+}
+// Reserved ranges do not overlap data not written out yet, no lock needed
+void ReorderBuffer::Write(size_t offset, const char* data, size_t size) {
+    while (size > 0) {
+        const size_t pos = offset % capacity_;
+        const size_t n = min(size, capacity_ - pos);
+        memcpy(data_.get() + pos, data, n);
+        data += n;
+        offset += n;
+        size -= n;
+    }
+}
+void ReorderBuffer::Complete(size_t begin, size_t end) {
+    {
+        const lock_guard<mutex> lock(mutex_);
+        complete_[begin] = end;
+        // extend contiguous data
+        auto i = complete_.begin();
+        while (i != complete_.end() && i->first == ready_) {
+            ready_ = i->second;
+            i = complete_.erase(i);
+        }
+    }
+    ranges_.notify_all();
+}
+// Data is written out without holding the lock, producers only write past
+// the ready offset
+bool ReorderBuffer::Drain(size_t size) {
+    unique_lock<mutex> lock(mutex_);
+    while (written_ < size) {
+        ranges_.wait(lock, [&] { return aborted_ || ready_ > written_; });
+        if (aborted_) return false;
+        const size_t begin = written_;
+        const size_t end = ready_;
+        lock.unlock();
+        const bool ok = WriteOut(begin, end);
+        lock.lock();
+        if (!ok) {
+            aborted_ = true;
+            space_.notify_all();
+            return false;
+        }
+        written_ = end;
+        space_.notify_all();
+    }
+    return true;
+}
+void ReorderBuffer::Abort() {
+    {
+        const lock_guard<mutex> lock(mutex_);
+        aborted_ = true;
+    }
+    space_.notify_all();
+    ranges_.notify_all();
+}
+bool ReorderBuffer::Aborted() const {
+    const lock_guard<mutex> lock(mutex_);
+    return aborted_;
+}
+
+// private:
+// Write [begin, end) from ring to output, handling wrap-around and short
+// writes to pipes
+bool ReorderBuffer::WriteOut(size_t begin, size_t end) {
+    while (begin < end) {
+        const size_t pos = begin % capacity_;
+        const size_t n = min(end - begin, capacity_ - pos);
+        const ssize_t r = write(fd_, data_.get() + pos, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        begin += size_t(r);
+    }
+    return true;
+}
+
+}  // namespace sss
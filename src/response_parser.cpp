@@ -32,6 +32,7 @@
  ******************************************************************************/
 #include <regex>
 #include <string>
+#include <vector>
 
 namespace sss {
 
@@ -44,6 +45,17 @@ std::string XMLTag(const std::string& xml, const std::string& tag) {
     return sm[1];
 }
 
+std::vector<std::string> XMLElements(const std::string& xml,
+                                     const std::string& tag) {
+    const std::regex rx{"<" + tag + ">([\\s\\S]*?)</" + tag + ">"};
+    std::vector<std::string> elements;
+    for (auto i = std::sregex_iterator(begin(xml), end(xml), rx);
+         i != std::sregex_iterator(); ++i) {
+        elements.push_back((*i)[1]);
+    }
+    return elements;
+}
+
 std::string HTTPHeader(const std::string& headers, const std::string& header) {
     const std::regex rx{header + "\\s*:\\s*([^\\s]+)"};
     std::smatch sm;
@@ -0,0 +1,107 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file retry_policy.cpp
+ * \brief implementation of RetryPolicy class
+ */
+
+#include "retry_policy.h"
+
+#include <algorithm>
+#include <random>
+
+#include "response_parser.h"
+
+namespace sss {
+
+using namespace std;
+
+// public:
+RetryPolicy::RetryPolicy(int maxRetries, Duration baseDelay, Duration maxDelay)
+    : maxRetries_(max(maxRetries, 0)),
+      baseDelay_(baseDelay),
+      maxDelay_(maxDelay) {}
+// HTTP status has priority over libcurl code when a response was received
+RequestStatus RetryPolicy::Classify(CURLcode cc, long httpStatus) {
+    switch (httpStatus) {
+        case 408:  // Request Timeout
+        case 429:  // Too Many Requests
+        case 500:  // Internal Error
+        case 502:  // Bad Gateway
+        case 503:  // SlowDown, Service Unavailable
+        case 504:  // Gateway Timeout
+            return RequestStatus::RETRY;
+        default:
+            break;
+    }
+    if (httpStatus >= 400) return RequestStatus::FAIL;
+    // response received, send error caused by server closing the connection
+    if (httpStatus > 0 && (cc == CURLE_OK || cc == CURLE_SEND_ERROR)) {
+        return RequestStatus::OK;
+    }
+    switch (cc) {
+        case CURLE_OK:  // no response: connection closed before headers
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return RequestStatus::RETRY;
+        default:
+            return RequestStatus::FAIL;
+    }
+}
+// S3 returns 400 RequestTimeout when the connection is idle for too long
+RequestStatus RetryPolicy::Classify(const WebClient& client) {
+    if (client.StatusCode() == 400 &&
+        XMLTag(client.GetContentText(), "[Cc]ode") == "RequestTimeout") {
+        return RequestStatus::RETRY;
+    }
+    return Classify(client.CurlCode(), client.StatusCode());
+}
+// Full jitter: uniform in [0, min(maxDelay, baseDelay * 2^retry)]
+RetryPolicy::Duration RetryPolicy::Delay(int retry) const {
+    thread_local mt19937 engine{random_device{}()};
+    const auto cap = retry < 31 ? baseDelay_.count() << retry
+                                : maxDelay_.count();
+    const auto upper = max(min(cap, maxDelay_.count()), Duration::rep(0));
+    uniform_int_distribution<Duration::rep> dist(0, upper);
+    return Duration(dist(engine));
+}
+
+}  // namespace sss
@@ -0,0 +1,576 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file sha256_fast.cpp
+ * \brief implementation of Sha256 class and of the block compression
+ * backends
+ */
+
+#include "sha256_fast.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SSS_SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace sss {
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t H0[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// Compress numBlocks consecutive 64 byte blocks into state
+using Compress = void (*)(uint32_t* state, const uint8_t* data,
+                          size_t numBlocks);
+
+inline uint32_t Rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint32_t LoadBE32(const uint8_t* p) {
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 |
+           uint32_t(p[3]);
+}
+
+void CompressPortable(uint32_t* state, const uint8_t* data,
+                      size_t numBlocks) {
+    for (; numBlocks != 0; --numBlocks, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i != 16; ++i) w[i] = LoadBE32(data + 4 * i);
+        for (int i = 16; i != 64; ++i) {
+            const uint32_t s0 =
+                Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 =
+                Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i != 64; ++i) {
+            const uint32_t S1 = Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25);
+            const uint32_t ch = (e & f) ^ (~e & g);
+            const uint32_t t1 = h + S1 + ch + K[i] + w[i];
+            const uint32_t S0 = Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22);
+            const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            const uint32_t t2 = S0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef SSS_SHA256_X86
+// SSE/AVX rotation of each 32 bit lane
+#define SSS_ROTR_EPI32(x, n) \
+    _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+
+// AVX2 and BMI2: message schedule computed four words at a time in vector
+// registers together with W + K, rounds with three operand rorx rotations
+__attribute__((target("avx2,bmi2"))) void CompressAVX2(uint32_t* state,
+                                                       const uint8_t* data,
+                                                       size_t numBlocks) {
+    const __m128i MASK =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    for (; numBlocks != 0; --numBlocks, data += 64) {
+        alignas(16) uint32_t w[64];
+        alignas(16) uint32_t wk[64];
+        for (int i = 0; i != 16; i += 4) {
+            const __m128i x = _mm_shuffle_epi8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 4 * i)),
+                MASK);
+            _mm_store_si128(reinterpret_cast<__m128i*>(w + i), x);
+            _mm_store_si128(
+                reinterpret_cast<__m128i*>(wk + i),
+                _mm_add_epi32(x, _mm_loadu_si128(
+                                     reinterpret_cast<const __m128i*>(K + i))));
+        }
+        for (int t = 16; t != 64; t += 4) {
+            auto load = [&w](int i) {
+                return _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i));
+            };
+            const __m128i w15 = load(t - 15);
+            const __m128i s0 =
+                _mm_xor_si128(_mm_xor_si128(SSS_ROTR_EPI32(w15, 7),
+                                            SSS_ROTR_EPI32(w15, 18)),
+                              _mm_srli_epi32(w15, 3));
+            __m128i x =
+                _mm_add_epi32(_mm_add_epi32(load(t - 16), s0), load(t - 7));
+            // s1 of W[t-2], W[t-1] gives W[t], W[t+1]; s1 of those gives
+            // W[t+2], W[t+3]
+            auto s1 = [](__m128i v) {
+                return _mm_xor_si128(_mm_xor_si128(SSS_ROTR_EPI32(v, 17),
+                                                   SSS_ROTR_EPI32(v, 19)),
+                                     _mm_srli_epi32(v, 10));
+            };
+            const __m128i w2 = _mm_loadl_epi64(
+                reinterpret_cast<const __m128i*>(w + t - 2));
+            x = _mm_add_epi32(x, s1(w2));
+            x = _mm_add_epi32(x, s1(_mm_slli_si128(x, 8)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(w + t), x);
+            _mm_store_si128(
+                reinterpret_cast<__m128i*>(wk + t),
+                _mm_add_epi32(x, _mm_loadu_si128(
+                                     reinterpret_cast<const __m128i*>(K + t))));
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+#pragma GCC unroll 64
+        for (int i = 0; i != 64; ++i) {
+            const uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) +
+                                ((e & f) ^ (~e & g)) + wk[i];
+            const uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) +
+                                ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+#undef SSS_ROTR_EPI32
+
+// SHA extensions: two rounds per sha256rnds2 instruction, the state is
+// kept as ABEF and CDGH vectors as required by the instruction
+__attribute__((target("sha,sse4.1"))) void CompressSHANI(uint32_t* state,
+                                                        const uint8_t* data,
+                                                        size_t numBlocks) {
+    const __m128i MASK =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+    __m128i state1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);                // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);          // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);       // CDGH
+    for (; numBlocks != 0; --numBlocks, data += 64) {
+        const __m128i abef = state0;
+        const __m128i cdgh = state1;
+        __m128i w[4];
+        for (int i = 0; i != 4; ++i) {
+            w[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(data + 16 * i)),
+                MASK);
+        }
+#pragma GCC unroll 16
+        for (int i = 0; i != 16; ++i) {
+            if (i >= 4) {
+                // W[t] = s1(W[t-2]) + W[t-7] + s0(W[t-15]) + W[t-16]
+                __m128i& x0 = w[i % 4];
+                const __m128i x1 = w[(i + 1) % 4];
+                const __m128i x2 = w[(i + 2) % 4];
+                const __m128i x3 = w[(i + 3) % 4];
+                x0 = _mm_sha256msg2_epu32(
+                    _mm_add_epi32(_mm_sha256msg1_epu32(x0, x1),
+                                  _mm_alignr_epi8(x3, x2, 4)),
+                    x3);
+            }
+            __m128i msg = _mm_add_epi32(
+                w[i % 4],
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(K + 4 * i)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+    tmp = _mm_shuffle_epi32(state0, 0x1B);        // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);     // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);  // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);     // HGFE
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+}
+
+#define SSS_ROTR_EPI32X8(x, n) \
+    _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define SSS_XOR3_EPI32X8(a, b, c) \
+    _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+
+// Eight streams, one per 32 bit lane of AVX2 registers; message words are
+// loaded by transposing 8x8 blocks of words
+__attribute__((target("avx2"))) void CompressAVX2x8(
+    uint32_t* const* states, const uint8_t* const* data, size_t numBlocks) {
+    const __m256i BSWAP = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15,
+        8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m256i s[8];
+    for (int j = 0; j != 8; ++j) {
+        s[j] = _mm256_set_epi32(states[7][j], states[6][j], states[5][j],
+                                states[4][j], states[3][j], states[2][j],
+                                states[1][j], states[0][j]);
+    }
+    for (size_t n = 0; n != numBlocks; ++n) {
+        __m256i w[16];
+        for (int half = 0; half != 2; ++half) {
+            __m256i r[8], t[8], u[8];
+            for (int l = 0; l != 8; ++l) {
+                r[l] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+                    data[l] + 64 * n + 32 * half));
+            }
+            for (int l = 0; l != 8; l += 2) {
+                t[l] = _mm256_unpacklo_epi32(r[l], r[l + 1]);
+                t[l + 1] = _mm256_unpackhi_epi32(r[l], r[l + 1]);
+            }
+            for (int l = 0; l != 8; l += 4) {
+                u[l] = _mm256_unpacklo_epi64(t[l], t[l + 2]);
+                u[l + 1] = _mm256_unpackhi_epi64(t[l], t[l + 2]);
+                u[l + 2] = _mm256_unpacklo_epi64(t[l + 1], t[l + 3]);
+                u[l + 3] = _mm256_unpackhi_epi64(t[l + 1], t[l + 3]);
+            }
+            __m256i* c = w + 8 * half;
+            for (int l = 0; l != 4; ++l) {
+                c[l] = _mm256_shuffle_epi8(
+                    _mm256_permute2x128_si256(u[l], u[l + 4], 0x20), BSWAP);
+                c[l + 4] = _mm256_shuffle_epi8(
+                    _mm256_permute2x128_si256(u[l], u[l + 4], 0x31), BSWAP);
+            }
+        }
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3];
+        __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+#pragma GCC unroll 16
+        for (int i = 0; i != 64; ++i) {
+            if (i >= 16) {
+                const __m256i w15 = w[(i - 15) & 15];
+                const __m256i w2 = w[(i - 2) & 15];
+                const __m256i s0 = SSS_XOR3_EPI32X8(
+                    SSS_ROTR_EPI32X8(w15, 7), SSS_ROTR_EPI32X8(w15, 18),
+                    _mm256_srli_epi32(w15, 3));
+                const __m256i s1 = SSS_XOR3_EPI32X8(
+                    SSS_ROTR_EPI32X8(w2, 17), SSS_ROTR_EPI32X8(w2, 19),
+                    _mm256_srli_epi32(w2, 10));
+                w[i & 15] = _mm256_add_epi32(
+                    _mm256_add_epi32(w[i & 15], s0),
+                    _mm256_add_epi32(w[(i - 7) & 15], s1));
+            }
+            const __m256i S1 = SSS_XOR3_EPI32X8(
+                SSS_ROTR_EPI32X8(e, 6), SSS_ROTR_EPI32X8(e, 11),
+                SSS_ROTR_EPI32X8(e, 25));
+            const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                                _mm256_andnot_si256(e, g));
+            const __m256i kw =
+                _mm256_add_epi32(_mm256_set1_epi32(int(K[i])), w[i & 15]);
+            const __m256i t1 = _mm256_add_epi32(
+                _mm256_add_epi32(h, S1), _mm256_add_epi32(ch, kw));
+            const __m256i S0 = SSS_XOR3_EPI32X8(
+                SSS_ROTR_EPI32X8(a, 2), SSS_ROTR_EPI32X8(a, 13),
+                SSS_ROTR_EPI32X8(a, 22));
+            const __m256i maj = SSS_XOR3_EPI32X8(_mm256_and_si256(a, b),
+                                                 _mm256_and_si256(a, c),
+                                                 _mm256_and_si256(b, c));
+            const __m256i t2 = _mm256_add_epi32(S0, maj);
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(t1, t2);
+        }
+        s[0] = _mm256_add_epi32(s[0], a);
+        s[1] = _mm256_add_epi32(s[1], b);
+        s[2] = _mm256_add_epi32(s[2], c);
+        s[3] = _mm256_add_epi32(s[3], d);
+        s[4] = _mm256_add_epi32(s[4], e);
+        s[5] = _mm256_add_epi32(s[5], f);
+        s[6] = _mm256_add_epi32(s[6], g);
+        s[7] = _mm256_add_epi32(s[7], h);
+    }
+    for (int j = 0; j != 8; ++j) {
+        alignas(32) uint32_t v[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(v), s[j]);
+        for (int l = 0; l != 8; ++l) states[l][j] = v[l];
+    }
+}
+
+#undef SSS_ROTR_EPI32X8
+#undef SSS_XOR3_EPI32X8
+#endif
+
+struct Backend {
+    Compress compress;
+    const char* name;
+};
+
+// Select backend through CPUID; AVX2 also requires the OS to save the
+// YMM registers
+Backend SelectBackend() {
+#ifdef SSS_SHA256_X86
+    unsigned a = 0, b = 0, c = 0, d = 0;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return {CompressPortable, "portable"};
+    const bool ssse3 = c & (1u << 9);
+    const bool sse41 = c & (1u << 19);
+    const bool osxsave = c & (1u << 27);
+    const bool avx = c & (1u << 28);
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+        return {CompressPortable, "portable"};
+    }
+    const bool avx2 = b & (1u << 5);
+    const bool bmi2 = b & (1u << 8);
+    const bool sha = b & (1u << 29);
+    if (sha && ssse3 && sse41) return {CompressSHANI, "sha-ni"};
+    if (avx2 && bmi2 && avx && osxsave) {
+        unsigned lo = 0, hi = 0;
+        __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        if ((lo & 6) == 6) return {CompressAVX2, "avx2"};
+    }
+#endif
+    return {CompressPortable, "portable"};
+}
+
+const Backend& GetBackend() {
+    static const Backend backend = SelectBackend();
+    return backend;
+}
+
+// Compress numBlocks blocks of \c width streams at once
+using CompressMulti = void (*)(uint32_t* const* states,
+                               const uint8_t* const* data, size_t numBlocks);
+
+struct MultiBackend {
+    CompressMulti compress;  // null: streams hashed one at a time
+    size_t width;            // number of streams per call
+    const char* name;
+};
+
+// One stream at a time with the SHA extensions is already faster than
+// eight AVX2 lanes, and interleaving two streams does not help
+MultiBackend SelectMultiBackend() {
+#ifdef SSS_SHA256_X86
+    if (string(GetBackend().name) == "avx2") {
+        return {CompressAVX2x8, 8, "avx2-x8"};
+    }
+#endif
+    return {nullptr, 1, "serial"};
+}
+
+const MultiBackend& GetMultiBackend() {
+    static const MultiBackend backend = SelectMultiBackend();
+    return backend;
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void Sha256::Reset() {
+    memcpy(state_, H0, sizeof(state_));
+    bufferSize_ = 0;
+    numBytes_ = 0;
+}
+
+//------------------------------------------------------------------------------
+void Sha256::Add(const void* data, size_t size) {
+    if (size == 0) return;  // data can be null
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const Compress compress = GetBackend().compress;
+    numBytes_ += size;
+    if (bufferSize_ > 0) {
+        const size_t n = min(size, BLOCK_BYTES - bufferSize_);
+        memcpy(buffer_ + bufferSize_, p, n);
+        bufferSize_ += n;
+        p += n;
+        size -= n;
+        if (bufferSize_ < BLOCK_BYTES) return;
+        compress(state_, buffer_, 1);
+        bufferSize_ = 0;
+    }
+    // full blocks are compressed in place
+    const size_t numBlocks = size / BLOCK_BYTES;
+    if (numBlocks > 0) compress(state_, p, numBlocks);
+    p += numBlocks * BLOCK_BYTES;
+    size -= numBlocks * BLOCK_BYTES;
+    memcpy(buffer_, p, size);
+    bufferSize_ = size;
+}
+
+//------------------------------------------------------------------------------
+// Padding: 0x80, zeros, 64 bit big endian length in bits
+void Sha256::Hash(uint8_t* out) const {
+    uint8_t tail[2 * BLOCK_BYTES] = {0};
+    memcpy(tail, buffer_, bufferSize_);
+    tail[bufferSize_] = 0x80;
+    const size_t numBlocks = bufferSize_ + 9 > BLOCK_BYTES ? 2 : 1;
+    const uint64_t bits = numBytes_ * 8;
+    for (int i = 0; i != 8; ++i) {
+        tail[numBlocks * BLOCK_BYTES - 1 - i] = uint8_t(bits >> (8 * i));
+    }
+    uint32_t state[8];
+    memcpy(state, state_, sizeof(state));
+    GetBackend().compress(state, tail, numBlocks);
+    for (int i = 0; i != 8; ++i) {
+        out[4 * i] = uint8_t(state[i] >> 24);
+        out[4 * i + 1] = uint8_t(state[i] >> 16);
+        out[4 * i + 2] = uint8_t(state[i] >> 8);
+        out[4 * i + 3] = uint8_t(state[i]);
+    }
+}
+
+//------------------------------------------------------------------------------
+string Sha256::HexHash() const {
+    static const char* digits = "0123456789abcdef";
+    uint8_t h[HASH_SIZE];
+    Hash(h);
+    string s(2 * HASH_SIZE, '\0');
+    for (size_t i = 0; i != HASH_SIZE; ++i) {
+        s[2 * i] = digits[h[i] >> 4];
+        s[2 * i + 1] = digits[h[i] & 0xf];
+    }
+    return s;
+}
+
+//------------------------------------------------------------------------------
+const char* Sha256::Backend() { return GetBackend().name; }
+
+//------------------------------------------------------------------------------
+// Complete partial blocks one stream at a time, then compress full blocks
+// of up to width streams together, the min number of blocks of the
+// streams in the group at each step; remaining data is buffered
+void Sha256MultiBuffer::Add(const void* const* data, const size_t* sizes) {
+    const Compress compress = GetBackend().compress;
+    const MultiBackend& multi = GetMultiBackend();
+    const uint8_t* p[LANES];
+    size_t numBlocks[LANES];
+    size_t tails[LANES];
+    for (size_t l = 0; l != LANES; ++l) {
+        Sha256& h = lanes_[l];
+        p[l] = static_cast<const uint8_t*>(data[l]);
+        size_t size = sizes[l];
+        h.numBytes_ += size;
+        if (h.bufferSize_ > 0 && size > 0) {
+            const size_t n = min(size, Sha256::BLOCK_BYTES - h.bufferSize_);
+            memcpy(h.buffer_ + h.bufferSize_, p[l], n);
+            h.bufferSize_ += n;
+            p[l] += n;
+            size -= n;
+            if (h.bufferSize_ == Sha256::BLOCK_BYTES) {
+                compress(h.state_, h.buffer_, 1);
+                h.bufferSize_ = 0;
+            }
+        }
+        numBlocks[l] = size / Sha256::BLOCK_BYTES;
+        tails[l] = size % Sha256::BLOCK_BYTES;
+    }
+    while (true) {
+        size_t group[LANES];
+        size_t n = 0;
+        for (size_t l = 0; l != LANES && n != multi.width; ++l) {
+            if (numBlocks[l] > 0) group[n++] = l;
+        }
+        if (n == 0) break;
+        if (n == 1 || !multi.compress) {
+            const size_t l = group[0];
+            compress(lanes_[l].state_, p[l], numBlocks[l]);
+            p[l] += numBlocks[l] * Sha256::BLOCK_BYTES;
+            numBlocks[l] = 0;
+            continue;
+        }
+        size_t k = numBlocks[group[0]];
+        for (size_t i = 1; i != n; ++i) k = min(k, numBlocks[group[i]]);
+        // unused lanes hash the data of the first one into a scratch state
+        uint32_t scratch[8] = {0};
+        uint32_t* states[LANES];
+        const uint8_t* d[LANES];
+        for (size_t i = 0; i != multi.width; ++i) {
+            states[i] = i < n ? lanes_[group[i]].state_ : scratch;
+            d[i] = i < n ? p[group[i]] : p[group[0]];
+        }
+        multi.compress(states, d, k);
+        for (size_t i = 0; i != n; ++i) {
+            p[group[i]] += k * Sha256::BLOCK_BYTES;
+            numBlocks[group[i]] -= k;
+        }
+    }
+    for (size_t l = 0; l != LANES; ++l) {
+        if (tails[l] == 0) continue;
+        memcpy(lanes_[l].buffer_, p[l], tails[l]);
+        lanes_[l].bufferSize_ = tails[l];
+    }
+}
+
+//------------------------------------------------------------------------------
+const char* Sha256MultiBuffer::Backend() { return GetMultiBackend().name; }
+
+//------------------------------------------------------------------------------
+string Sha256Hex(const void* data, size_t size) {
+    Sha256 sha256;
+    sha256.Add(data, size);
+    return sha256.HexHash();
+}
+
+}  // namespace sss
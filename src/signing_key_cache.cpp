@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file signing_key_cache.cpp
+ * \brief implementation of SigningKeyCache class
+ */
+
+#include "signing_key_cache.h"
+
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+namespace sss {
+
+//------------------------------------------------------------------------------
+const SigningKey& SigningKeyCache::Get(const string& secret,
+                                      const string& date, const string& region,
+                                      const string& service) {
+    // date is not part of the slot index: an entry from a previous day is
+    // replaced in place
+    const size_t h = hash<string>()(secret) ^
+                     (hash<string>()(region) * 31 + hash<string>()(service));
+    size_t slot = NUM_SLOTS;
+    for (size_t i = 0; i != NUM_SLOTS; ++i) {
+        const size_t s = (h + i) % NUM_SLOTS;
+        const Entry* e = slots_[s].load(memory_order_acquire);
+        if (!e) {
+            if (slot == NUM_SLOTS) slot = s;
+            break;
+        }
+        if (e->secret == secret && e->region == region &&
+            e->service == service) {
+            if (e->date == date) return e->key;
+            slot = s;
+            break;
+        }
+    }
+    // all slots taken by other tuples: evict the first one probed
+    if (slot == NUM_SLOTS) slot = h % NUM_SLOTS;
+    const vector<uint8_t> key = derive_(secret, date, region, service);
+    unique_ptr<Entry> e(new Entry{secret, date, region, service,
+                                  {key, HmacSha256(key.data(), key.size())}});
+    const Entry* p = e.get();
+    {
+        // a signature is computed right after the lookup, a reader cannot
+        // be using an entry replaced one day ago
+        lock_guard<mutex> lock(entriesMutex_);
+        const auto now = chrono::steady_clock::now();
+        const auto expired = find_if(
+            retired_.begin(), retired_.end(), [now](const Retired& r) {
+                return now - r.time < chrono::hours(24);
+            });
+        retired_.erase(retired_.begin(), expired);
+        if (entries_[slot]) retired_.push_back({move(entries_[slot]), now});
+        entries_[slot] = move(e);
+        slots_[slot].store(p, memory_order_release);
+    }
+    return p->key;
+}
+
+}  // namespace sss
@@ -0,0 +1,310 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file transfer_engine.cpp
+ * \brief implementation of TransferEngine class, event loop driving libcurl
+ * multi handle through epoll
+ */
+
+#include "transfer_engine.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace sss {
+
+using namespace std;
+
+// public:
+TransferEngine::TransferEngine(int maxInFlight)
+    : maxInFlight_(max(maxInFlight, 1)) {
+    // libcurl must be initialized before creating the multi handle
+    WebClient::GlobalInit();
+    multi_ = curl_multi_init();
+    if (!multi_) {
+        throw runtime_error("Cannot create curl multi handle");
+    }
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd_ < 0) {
+        curl_multi_cleanup(multi_);
+        throw runtime_error(string("Cannot create epoll instance: ") +
+                            strerror(errno));
+    }
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, TimerCallback);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+    // multiplex transfers over HTTP/2 connections when possible
+    curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+}
+// Remove in-flight transfers before cleaning up multi handle
+TransferEngine::~TransferEngine() {
+    for (auto& t : transfers_) {
+        curl_multi_remove_handle(multi_, t.first);
+    }
+    transfers_.clear();
+    curl_multi_cleanup(multi_);
+    close(epollFd_);
+}
+// Add transfer to multi handle, libcurl will request a timeout to start it
+void TransferEngine::Add(std::unique_ptr<WebClient> client, Completion done) {
+    CURL* easy = client->curl_;
+    if (curl_multi_add_handle(multi_, easy) != CURLM_OK) {
+        throw runtime_error("Cannot add transfer to curl multi handle");
+    }
+    Transfer& t = transfers_[easy];
+    t.client = move(client);
+    t.done = move(done);
+    t.start = Clock::now();
+}
+// Add transfer to delayed queue, started from the event loop when due
+void TransferEngine::AddAfter(chrono::milliseconds delay,
+                              std::unique_ptr<WebClient> client,
+                              Completion done) {
+    Transfer t;
+    t.client = move(client);
+    t.done = move(done);
+    delayed_.emplace(Clock::now() + delay, move(t));
+}
+// Add transfer recording hedge function, checked by CheckHedges()
+void TransferEngine::AddHedged(std::unique_ptr<WebClient> client,
+                               Completion done, size_t bytes, Hedge hedge) {
+    CURL* easy = client->curl_;
+    Add(move(client), move(done));
+    if (!hedgePolicy_) return;
+    hedgePolicy_->Started();
+    Transfer& t = transfers_[easy];
+    t.hedge = move(hedge);
+    t.bytes = bytes;
+    hedgeable_ = true;
+}
+// Event loop: wait for socket events or libcurl timeouts and invoke
+// curl_multi_socket_action accordingly
+void TransferEngine::Run(const Source& source) {
+    bool sourceDone = !source;
+    bool sourceWait = false;
+    auto fill = [&]() {
+        sourceWait = false;
+        while (!sourceDone && !sourceWait &&
+               InFlight() < size_t(maxInFlight_)) {
+            const SourceStatus status = source(*this);
+            sourceDone = status == SourceStatus::DONE;
+            sourceWait = status == SourceStatus::WAIT;
+        }
+    };
+    fill();
+    const int MAX_EVENTS = 64;
+    // max time between source invocations when the source is waiting
+    const int WAIT_MS = 10;
+    vector<epoll_event> events(MAX_EVENTS);
+    while (InFlight() > 0 || sourceWait) {
+        StartDelayed();
+        CheckHedges();
+        // wake up at the earliest of libcurl timeout and delayed transfer
+        const bool wait = timerSet_ || !delayed_.empty();
+        Clock::time_point deadline = timerSet_ ? deadline_ : Clock::now();
+        if (!delayed_.empty()) {
+            deadline = timerSet_ ? min(deadline_, delayed_.begin()->first)
+                                 : delayed_.begin()->first;
+        }
+        int timeout = -1;
+        if (wait) {
+            const auto ms = chrono::duration_cast<chrono::milliseconds>(
+                                deadline - Clock::now())
+                                .count();
+            timeout = int(max<long long>(ms, 0));
+        }
+        // hedging delays are checked at the same interval
+        if ((sourceWait || hedgeable_) && (timeout < 0 || timeout > WAIT_MS)) {
+            timeout = WAIT_MS;
+        }
+        const int n = epoll_wait(epollFd_, events.data(), MAX_EVENTS, timeout);
+        if (n < 0 && errno != EINTR) {
+            throw runtime_error(string("Error waiting for events: ") +
+                                strerror(errno));
+        }
+        for (int i = 0; i < n; ++i) {
+            int mask = 0;
+            if (events[i].events & EPOLLIN) mask |= CURL_CSELECT_IN;
+            if (events[i].events & EPOLLOUT) mask |= CURL_CSELECT_OUT;
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                mask |= CURL_CSELECT_ERR;
+            Action(events[i].data.fd, mask);
+        }
+        // socket events can keep the loop busy: check timeout explicitly
+        if (timerSet_ && Clock::now() >= deadline_) {
+            timerSet_ = false;
+            Action(CURL_SOCKET_TIMEOUT, 0);
+        }
+        CheckCompleted();
+        fill();
+    }
+}
+// Set max number of HTTP/2 streams per connection
+bool TransferEngine::SetMaxConcurrentStreams(long n) {
+    return curl_multi_setopt(multi_, CURLMOPT_MAX_CONCURRENT_STREAMS, n) ==
+           CURLM_OK;
+}
+
+// private:
+// Invoked by libcurl to (un)register interest in socket events
+int TransferEngine::SocketCallback(CURL*, curl_socket_t s, int what,
+                                   TransferEngine* engine, void* socketp) {
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(engine->epollFd_, EPOLL_CTL_DEL, s, NULL);
+        curl_multi_assign(engine->multi_, s, NULL);
+        return 0;
+    }
+    epoll_event ev{};
+    ev.data.fd = s;
+    if (what & CURL_POLL_IN) ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+    // socketp is used to mark sockets already registered with epoll
+    const int op = socketp ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(engine->epollFd_, op, s, &ev) < 0) return -1;
+    if (!socketp) curl_multi_assign(engine->multi_, s, engine);
+    return 0;
+}
+// Invoked by libcurl to request a timeout, -1 deletes the timer
+int TransferEngine::TimerCallback(CURLM*, long timeoutMs,
+                                  TransferEngine* engine) {
+    engine->timerSet_ = timeoutMs >= 0;
+    if (engine->timerSet_) {
+        engine->deadline_ = Clock::now() + chrono::milliseconds(timeoutMs);
+    }
+    return 0;
+}
+// Let libcurl process socket event or timeout
+void TransferEngine::Action(curl_socket_t s, int mask) {
+    int running = 0;
+    const CURLMcode rc = curl_multi_socket_action(multi_, s, mask, &running);
+    if (rc != CURLM_OK) {
+        throw runtime_error(string("Error processing transfers: ") +
+                            curl_multi_strerror(rc));
+    }
+}
+// Move delayed transfers which are due to multi handle
+void TransferEngine::StartDelayed() {
+    const auto now = Clock::now();
+    while (!delayed_.empty() && delayed_.begin()->first <= now) {
+        Transfer t = move(delayed_.begin()->second);
+        delayed_.erase(delayed_.begin());
+        Add(move(t.client), move(t.done));
+    }
+}
+// Add duplicates of transfers in flight longer than the hedging delay;
+// a transfer whose duplicate cannot be created now is checked again later
+void TransferEngine::CheckHedges() {
+    if (!hedgePolicy_ || !hedgeable_) return;
+    hedgeable_ = false;
+    const auto now = Clock::now();
+    vector<CURL*> due;
+    for (auto& t : transfers_) {
+        if (!t.second.hedge) continue;
+        const double delay = hedgePolicy_->Delay(t.second.bytes);
+        if (delay >= 0 &&
+            now - t.second.start > chrono::duration<double>(delay)) {
+            due.push_back(t.first);
+        } else {
+            hedgeable_ = true;
+        }
+    }
+    for (CURL* easy : due) {
+        hedgeable_ = true;
+        if (!hedgePolicy_->CanHedge()) break;
+        auto i = transfers_.find(easy);
+        Completion done;
+        unique_ptr<WebClient> h = i->second.hedge(done);
+        if (!h) continue;
+        i->second.hedge = nullptr;
+        i->second.twin = h->curl_;
+        const size_t bytes = i->second.bytes;
+        CURL* he = h->curl_;
+        Add(move(h), move(done));
+        Transfer& t = transfers_[he];
+        t.twin = easy;
+        t.bytes = bytes;
+        hedgePolicy_->Hedged();
+    }
+}
+// Remove transfer and invoke its completion function as cancelled
+void TransferEngine::Cancel(CURL* easy) {
+    auto i = transfers_.find(easy);
+    if (i == transfers_.end()) return;
+    curl_multi_remove_handle(multi_, easy);
+    Transfer t = move(i->second);
+    transfers_.erase(i);
+    t.client->Cancel();
+    t.client->Done(CURLE_ABORTED_BY_CALLBACK);
+    if (t.done) t.done(*t.client, false);
+}
+// Remove completed transfers and invoke completion functions; the transfer
+// is removed first so that completion functions can add new transfers
+void TransferEngine::CheckCompleted() {
+    int pending = 0;
+    while (CURLMsg* msg = curl_multi_info_read(multi_, &pending)) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        CURL* easy = msg->easy_handle;
+        const CURLcode result = msg->data.result;
+        curl_multi_remove_handle(multi_, easy);
+        auto i = transfers_.find(easy);
+        if (i == transfers_.end()) continue;
+        Transfer t = move(i->second);
+        transfers_.erase(i);
+        const bool ok = t.client->Done(result);
+        CURL* twin = NULL;
+        if (t.twin && transfers_.count(t.twin)) {
+            transfers_[t.twin].twin = NULL;
+            // first to succeed wins, a failure is superseded by the twin
+            if (ok) {
+                twin = t.twin;
+            } else {
+                t.client->Cancel();
+            }
+        }
+        if (ok && hedgePolicy_ && t.bytes > 0) {
+            hedgePolicy_->Completed(t.client->TransferTime(), t.bytes);
+        }
+        // the loser is cancelled, and its buffered output flushed, before
+        // the completion of the winner can record the data as written
+        if (twin) Cancel(twin);
+        if (t.done) t.done(*t.client, ok);
+    }
+}
+
+}  // namespace sss
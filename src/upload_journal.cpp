@@ -0,0 +1,147 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file upload_journal.cpp
+ * \brief implementation of UploadJournal class
+ */
+
+#include "upload_journal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace sss {
+
+using namespace std;
+
+// public:
+UploadJournal::UploadJournal(const string& path) : path_(path) {
+    const size_t size = Read();
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw runtime_error("Cannot open journal file " + path_ + ": " +
+                            strerror(errno));
+    }
+    // drop incomplete record so that the next one starts on a new line
+    if (ftruncate(fd_, off_t(size)) != 0) {
+        throw runtime_error("Cannot truncate journal file " + path_ + ": " +
+                            strerror(errno));
+    }
+}
+UploadJournal::~UploadJournal() {
+    if (fd_ >= 0) close(fd_);
+}
+// Record upload
+void UploadJournal::Begin(const string& uploadId, const string& bucket,
+                          const string& key, size_t fileSize,
+                          size_t partSize, uint64_t fileTime,
+                          uint64_t fileInode) {
+    if (HasUpload()) {
+        throw logic_error("Journal " + path_ + " already contains upload " +
+                          uploadId_);
+    }
+    uploadId_ = uploadId;
+    bucket_ = bucket;
+    key_ = key;
+    fileSize_ = fileSize;
+    partSize_ = partSize;
+    fileTime_ = fileTime;
+    fileInode_ = fileInode;
+    // key is last since it can contain spaces
+    Append("upload " + uploadId + " " + to_string(fileSize) + " " +
+           to_string(partSize) + " " + to_string(fileTime) + " " +
+           to_string(fileInode) + " " + bucket + " " + key);
+}
+// Record part
+void UploadJournal::AddPart(int partNumber, const string& etag) {
+    const lock_guard<mutex> lock(mutex_);
+    parts_[partNumber] = etag;
+    Append("part " + to_string(partNumber) + " " + etag);
+}
+// Delete journal file
+void UploadJournal::Remove() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+    unlink(path_.c_str());
+}
+
+// private:
+// Read records from existing file; lines not terminated by a newline are the
+// result of an interrupted write and are discarded; returns the size of the
+// valid records
+size_t UploadJournal::Read() {
+    ifstream in(path_);
+    if (!in) return 0;
+    const string content((istreambuf_iterator<char>(in)),
+                         istreambuf_iterator<char>());
+    const size_t size = content.rfind('\n') + 1;
+    istringstream is(content.substr(0, size));
+    string line;
+    while (getline(is, line)) {
+        istringstream ls(line);
+        string type;
+        ls >> type;
+        if (type == "upload") {
+            ls >> uploadId_ >> fileSize_ >> partSize_ >> fileTime_ >>
+                fileInode_ >> bucket_;
+            ls.get();
+            getline(ls, key_);
+        } else if (type == "part") {
+            int partNumber = 0;
+            string etag;
+            ls >> partNumber >> etag;
+            if (partNumber > 0 && !etag.empty()) parts_[partNumber] = etag;
+        }
+        if (ls.fail()) {
+            throw runtime_error("Invalid record in journal " + path_ + ": " +
+                                line);
+        }
+    }
+    return size;
+}
+// Append record and flush to disk
+void UploadJournal::Append(const string& record) {
+    const string line = record + "\n";
+    if (write(fd_, line.data(), line.size()) != ssize_t(line.size()) ||
+        fdatasync(fd_) != 0) {
+        throw runtime_error("Cannot write to journal file " + path_ + ": " +
+                            strerror(errno));
+    }
+}
+
+}  // namespace sss
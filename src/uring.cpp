@@ -0,0 +1,213 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file uring.cpp
+ * \brief implementation of IOURing class
+ */
+
+#include "uring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace sss {
+
+using namespace std;
+
+namespace {
+
+int Setup(unsigned entries, io_uring_params* p) {
+    return int(syscall(__NR_io_uring_setup, entries, p));
+}
+int Enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return int(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                       NULL, 0));
+}
+int Register(int fd, unsigned opcode, const void* arg, unsigned n) {
+    return int(syscall(__NR_io_uring_register, fd, opcode, arg, n));
+}
+string Error(const string& msg) { return msg + ": " + strerror(errno); }
+
+}  // namespace
+
+// public:
+IOURing::IOURing(unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    fd_ = Setup(entries, &p);
+    if (fd_ < 0) throw runtime_error(Error("Cannot create io_uring"));
+    sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    // with a single mapping both rings share the same memory
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sqRingSize_ = cqRingSize_ = max(sqRingSize_, cqRingSize_);
+    sqRing_ = mmap(NULL, sqRingSize_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        sqRing_ = nullptr;
+        Release();
+        throw runtime_error(Error("Cannot map io_uring submission queue"));
+    }
+    cqRing_ = single ? sqRing_
+                     : mmap(NULL, cqRingSize_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED) {
+        cqRing_ = nullptr;
+        Release();
+        throw runtime_error(Error("Cannot map io_uring completion queue"));
+    }
+    sqesSize_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(NULL, sqesSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        Release();
+        throw runtime_error(Error("Cannot map io_uring entries"));
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+}
+IOURing::~IOURing() { Release(); }
+bool IOURing::RegisterBuffers(const vector<iovec>& buffers) {
+    return Register(fd_, IORING_REGISTER_BUFFERS, buffers.data(),
+                    unsigned(buffers.size())) == 0;
+}
+void IOURing::UnregisterBuffers() {
+    Register(fd_, IORING_UNREGISTER_BUFFERS, NULL, 0);
+}
+void IOURing::RegisterFiles(const vector<int>& fds) {
+    if (Register(fd_, IORING_REGISTER_FILES, fds.data(),
+                 unsigned(fds.size())) < 0) {
+        throw runtime_error(Error("Cannot register io_uring files"));
+    }
+}
+void IOURing::UpdateFile(unsigned index, int fd) {
+    io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = index;
+    update.fds = reinterpret_cast<uint64_t>(&fd);
+    if (Register(fd_, IORING_REGISTER_FILES_UPDATE, &update, 1) < 0) {
+        throw runtime_error(Error("Cannot update io_uring files"));
+    }
+}
+void IOURing::PrepareRead(int file, int buffer, void* data, unsigned size,
+                          uint64_t offset, uint64_t userData) {
+    io_uring_sqe* sqe = NextSQE();
+    sqe->opcode = buffer < 0 ? IORING_OP_READ : IORING_OP_READ_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = file;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->buf_index = uint16_t(max(buffer, 0));
+    sqe->user_data = userData;
+}
+void IOURing::PrepareWrite(int file, int buffer, const void* data,
+                           unsigned size, uint64_t offset, uint64_t userData) {
+    io_uring_sqe* sqe = NextSQE();
+    sqe->opcode = buffer < 0 ? IORING_OP_WRITE : IORING_OP_WRITE_FIXED;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->fd = file;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->buf_index = uint16_t(max(buffer, 0));
+    sqe->user_data = userData;
+}
+// Submit pending entries and optionally wait for completions
+void IOURing::Submit(unsigned waitFor) {
+    while (toSubmit_ > 0 || waitFor > 0) {
+        const int r = Enter(fd_, toSubmit_, waitFor,
+                            waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            throw runtime_error(Error("Error submitting io_uring requests"));
+        }
+        toSubmit_ -= min(unsigned(r), toSubmit_);
+        break;
+    }
+}
+// Consume one completion entry
+bool IOURing::Complete(uint64_t& userData, int& result) {
+    const unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) return false;
+    const io_uring_cqe& cqe = cqes_[head & cqMask_];
+    userData = cqe.user_data;
+    result = cqe.res;
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// private:
+// Unmap queues and close ring, also invoked when the constructor fails
+void IOURing::Release() {
+    if (sqes_) munmap(sqes_, sqesSize_);
+    if (cqRing_ && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+    if (sqRing_) munmap(sqRing_, sqRingSize_);
+    if (fd_ >= 0) close(fd_);
+    sqes_ = nullptr;
+    cqRing_ = sqRing_ = nullptr;
+    fd_ = -1;
+}
+// Return next free submission entry, submitting queued entries if full
+io_uring_sqe* IOURing::NextSQE() {
+    unsigned tail = *sqTail_;
+    if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) > sqMask_) {
+        Submit();
+        tail = *sqTail_;
+    }
+    const unsigned index = tail & sqMask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    ++toSubmit_;
+    return sqe;
+}
+
+}  // namespace sss
@@ -0,0 +1,411 @@
+/*******************************************************************************
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2020-2022, Ugo Varetto
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+/**
+ * \file uring_file.cpp
+ * \brief implementation of URingFileSource and URingFileSink classes
+ */
+
+#include "uring_file.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace sss {
+
+using namespace std;
+
+namespace {
+
+const size_t ALIGNMENT = 4096;
+// registered file slots per thread, a region uses one file
+const size_t FILE_SLOTS = 16;
+// ring size, regions of an event loop thread queue operations concurrently
+const unsigned RING_ENTRIES = 128;
+
+size_t AlignUp(size_t n) { return (n + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+size_t AlignDown(size_t n) { return n & ~(ALIGNMENT - 1); }
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// URingContext
+
+// public:
+// The context is owned by the thread and by the regions using it, which can
+// outlive the thread
+shared_ptr<URingContext> URingContext::Get() {
+    thread_local shared_ptr<URingContext> context;
+    if (!context) context.reset(new URingContext);
+    return context;
+}
+URingContext::~URingContext() {
+    for (const auto& f : files_) {
+        if (f.fd >= 0) close(f.fd);
+    }
+    for (const auto& b : buffers_) free(b.data);
+}
+// A cached file is reused only if the name still refers to it, a free slot
+// or the slot of a file no longer in use receives a newly opened file
+int URingContext::AcquireFile(const string& fname, int flags) {
+    struct stat st;
+    const bool exists = stat(fname.c_str(), &st) == 0;
+    for (size_t i = 0; i != files_.size(); ++i) {
+        File& f = files_[i];
+        if (exists && f.fd >= 0 && f.name == fname && f.flags == flags &&
+            f.dev == st.st_dev && f.ino == st.st_ino) {
+            ++f.refs;
+            return int(i);
+        }
+    }
+    size_t slot = files_.size();
+    for (size_t i = 0; i != files_.size() && slot == files_.size(); ++i) {
+        if (files_[i].fd < 0) slot = i;
+    }
+    for (size_t i = 0; i != files_.size() && slot == files_.size(); ++i) {
+        if (files_[i].refs == 0) slot = i;
+    }
+    if (slot == files_.size()) {
+        throw runtime_error("Cannot open file " + fname +
+                            ": too many files in use through io_uring");
+    }
+    const int fd = open(fname.c_str(), flags | O_LARGEFILE, 0644);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        const int err = errno;
+        if (fd >= 0) close(fd);
+        throw runtime_error("Cannot open file " + fname + ": " +
+                            strerror(err));
+    }
+    try {
+        ring_.UpdateFile(unsigned(slot), fd);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    File& f = files_[slot];
+    if (f.fd >= 0) close(f.fd);
+    f = File{fname, flags, fd, st.st_dev, st.st_ino, 1};
+    return int(slot);
+}
+void URingContext::ReleaseFile(int file) { --files_[size_t(file)].refs; }
+// A new buffer is registered together with the existing ones; if
+// registration fails e.g. because the locked memory limit is exceeded, the
+// buffers are used without registration
+int URingContext::AcquireBuffer(size_t size) {
+    for (size_t i = 0; i != buffers_.size(); ++i) {
+        if (!buffers_[i].used && buffers_[i].size == size) {
+            buffers_[i].used = true;
+            return int(i);
+        }
+    }
+    void* p = nullptr;
+    if (posix_memalign(&p, ALIGNMENT, size)) throw bad_alloc();
+    buffers_.push_back({static_cast<char*>(p), size, true});
+    vector<iovec> iov;
+    for (const auto& b : buffers_) iov.push_back({b.data, b.size});
+    if (registered_) ring_.UnregisterBuffers();
+    registered_ = ring_.RegisterBuffers(iov);
+    return int(buffers_.size() - 1);
+}
+// Completions of operations queued by other regions are recorded as well
+void URingContext::Wait(const URingOp& op) {
+    uint64_t userData;
+    int result;
+    while (true) {
+        while (ring_.Complete(userData, result)) {
+            URingOp* done = reinterpret_cast<URingOp*>(userData);
+            done->result = result;
+            done->done = true;
+        }
+        if (op.done) return;
+        ring_.Submit(1);
+    }
+}
+
+// private:
+// Free slots of the registered file table are filled when files are opened
+URingContext::URingContext() : ring_(RING_ENTRIES) {
+    ring_.RegisterFiles(vector<int>(FILE_SLOTS, -1));
+    files_.resize(FILE_SLOTS);
+}
+
+//------------------------------------------------------------------------------
+// URingFileSource
+
+// public:
+URingFileSource::URingFileSource(const string& fname, size_t offset,
+                                 size_t size, size_t sliceSize, int queueDepth,
+                                 bool direct)
+    : context_(URingContext::Get()),
+      sliceSize_(AlignUp(max(sliceSize, size_t(1)))),
+      base_(direct ? AlignDown(offset) : offset),
+      end_(offset + size),
+      alignedEnd_(direct ? AlignUp(offset + size) : offset + size),
+      pos_(offset) {
+    numSlices_ = size == 0 ? 0 : (alignedEnd_ - base_ + sliceSize_ - 1) /
+                                     sliceSize_;
+    file_ = context_->AcquireFile(fname, O_RDONLY | (direct ? O_DIRECT : 0));
+    const size_t depth =
+        max(min(size_t(max(queueDepth, 1)), numSlices_), size_t(1));
+    try {
+        for (size_t i = 0; i != depth; ++i) {
+            buffers_.push_back(context_->AcquireBuffer(sliceSize_));
+        }
+    } catch (...) {
+        Release();
+        throw;
+    }
+    slices_.resize(depth, 0);
+    ops_.resize(depth);
+    results_.resize(depth, 0);
+    pending_.resize(depth, false);
+    for (size_t s = 0; s != min(depth, numSlices_); ++s) Queue(s);
+}
+URingFileSource::~URingFileSource() {
+    try {
+        for (size_t i = 0; i != ops_.size(); ++i) {
+            if (pending_[i]) context_->Wait(ops_[i]);
+        }
+    } catch (...) {
+    }
+    Release();
+}
+// Copy data out of current slice, when the slice is consumed its buffer is
+// reused to read the slice queueDepth positions ahead
+ssize_t URingFileSource::Read(char* ptr, size_t size) {
+    if (pos_ >= end_) return 0;
+    const size_t s = (pos_ - base_) / sliceSize_;
+    if (!Wait(s)) return -1;
+    const size_t slot = s % buffers_.size();
+    const size_t start = base_ + s * sliceSize_;
+    const size_t validEnd = min(start + size_t(results_[slot]), end_);
+    // file shorter than region
+    if (pos_ >= validEnd) return -1;
+    const size_t n = min(size, validEnd - pos_);
+    memcpy(ptr, context_->Data(buffers_[slot]) + (pos_ - start), n);
+    pos_ += n;
+    if (pos_ == min(start + sliceSize_, end_) &&
+        s + buffers_.size() < numSlices_) {
+        Queue(s + buffers_.size());
+    }
+    return ssize_t(n);
+}
+
+// private:
+// Queue read of slice into buffer slice % queue depth
+void URingFileSource::Queue(size_t s) {
+    const size_t slot = s % buffers_.size();
+    const size_t start = base_ + s * sliceSize_;
+    const size_t size = min(sliceSize_, alignedEnd_ - start);
+    slices_[slot] = s;
+    ops_[slot] = URingOp();
+    context_->Ring().PrepareRead(file_, context_->Index(buffers_[slot]),
+                                 context_->Data(buffers_[slot]),
+                                 unsigned(size), start,
+                                 URingContext::UserData(ops_[slot]));
+    pending_[slot] = true;
+    context_->Ring().Submit();
+}
+// Wait for read of slice to complete, return \c false on error; short reads
+// not caused by end of file are completed synchronously
+bool URingFileSource::Wait(size_t s) {
+    const size_t slot = s % buffers_.size();
+    if (!pending_[slot]) return results_[slot] >= 0;
+    context_->Wait(ops_[slot]);
+    pending_[slot] = false;
+    const size_t start = base_ + slices_[slot] * sliceSize_;
+    const size_t size = min(sliceSize_, alignedEnd_ - start);
+    char* data = context_->Data(buffers_[slot]);
+    int res = ops_[slot].result;
+    while (res >= 0 && size_t(res) < size && start + res < end_) {
+        const ssize_t r = pread(context_->Descriptor(file_), data + res,
+                                size - res, start + res);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        res += int(r);
+    }
+    results_[slot] = res;
+    return res >= 0;
+}
+// Return buffers and file to context, also invoked when the constructor
+// fails
+void URingFileSource::Release() {
+    for (auto b : buffers_) context_->ReleaseBuffer(b);
+    buffers_.clear();
+    if (file_ >= 0) context_->ReleaseFile(file_);
+    file_ = -1;
+}
+
+//------------------------------------------------------------------------------
+// URingFileSink
+
+// public:
+URingFileSink::URingFileSink(const string& fname, size_t offset,
+                             size_t sliceSize, int queueDepth, bool direct)
+    : context_(URingContext::Get()),
+      fname_(fname),
+      direct_(direct && offset % ALIGNMENT == 0),
+      sliceSize_(AlignUp(max(sliceSize, size_t(1)))),
+      offset_(offset) {
+    file_ = context_->AcquireFile(
+        fname, O_WRONLY | O_CREAT | (direct_ ? O_DIRECT : 0));
+    const size_t depth = size_t(max(queueDepth, 1));
+    try {
+        for (size_t i = 0; i != depth; ++i) {
+            buffers_.push_back(context_->AcquireBuffer(sliceSize_));
+        }
+    } catch (...) {
+        Release();
+        throw;
+    }
+    sizes_.resize(depth, 0);
+    offsets_.resize(depth, 0);
+    ops_.resize(depth);
+    pending_.resize(depth, false);
+}
+URingFileSink::~URingFileSink() {
+    try {
+        for (size_t i = 0; i != ops_.size(); ++i) {
+            if (pending_[i]) context_->Wait(ops_[i]);
+        }
+    } catch (...) {
+    }
+    Release();
+    if (tailFd_ >= 0) close(tailFd_);
+}
+// Copy data into current buffer, submit write when the buffer is full
+bool URingFileSink::Write(const char* data, size_t size) {
+    try {
+        while (size > 0 && !error_) {
+            if (pending_[current_]) Collect(current_);
+            const size_t n = min(size, sliceSize_ - fill_);
+            memcpy(context_->Data(buffers_[current_]) + fill_, data, n);
+            fill_ += n;
+            data += n;
+            size -= n;
+            if (fill_ == sliceSize_) Submit(fill_);
+        }
+    } catch (...) {
+        error_ = true;
+    }
+    return !error_;
+}
+// With O_DIRECT the unaligned tail is written synchronously, before the
+// aligned part of the buffer is submitted
+bool URingFileSink::Finish() {
+    if (finished_) return !error_;
+    finished_ = true;
+    try {
+        if (fill_ > 0 && !error_) {
+            const size_t aligned = direct_ ? AlignDown(fill_) : fill_;
+            if (aligned < fill_) {
+                WriteTail(context_->Data(buffers_[current_]) + aligned,
+                          fill_ - aligned, offset_ + aligned);
+            }
+            if (aligned > 0) Submit(aligned);
+        }
+        for (int i = 0; i != int(ops_.size()); ++i) {
+            if (pending_[i]) Collect(i);
+        }
+    } catch (...) {
+        error_ = true;
+    }
+    return !error_;
+}
+
+// private:
+// Submit write of current buffer and move to next one
+void URingFileSink::Submit(size_t size) {
+    const int slot = current_;
+    sizes_[slot] = size;
+    offsets_[slot] = offset_;
+    ops_[slot] = URingOp();
+    context_->Ring().PrepareWrite(file_, context_->Index(buffers_[slot]),
+                                  context_->Data(buffers_[slot]),
+                                  unsigned(size), offset_,
+                                  URingContext::UserData(ops_[slot]));
+    pending_[slot] = true;
+    context_->Ring().Submit();
+    offset_ += size;
+    fill_ = 0;
+    current_ = (current_ + 1) % int(buffers_.size());
+}
+// Wait for write from buffer to complete, short writes are completed
+// synchronously
+void URingFileSink::Collect(int slot) {
+    context_->Wait(ops_[slot]);
+    pending_[slot] = false;
+    const int res = ops_[slot].result;
+    if (res < 0) {
+        error_ = true;
+    } else if (size_t(res) < sizes_[slot]) {
+        WriteTail(context_->Data(buffers_[slot]) + res, sizes_[slot] - res,
+                  offsets_[slot] + res);
+    }
+}
+// Write through the page cache, used for data not aligned to page size
+void URingFileSink::WriteTail(const char* data, size_t size, size_t offset) {
+    if (tailFd_ < 0) tailFd_ = open(fname_.c_str(), O_WRONLY | O_LARGEFILE);
+    if (tailFd_ < 0) {
+        error_ = true;
+        return;
+    }
+    while (size > 0) {
+        const ssize_t r = pwrite(tailFd_, data, size, offset);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            error_ = true;
+            return;
+        }
+        data += r;
+        size -= size_t(r);
+        offset += size_t(r);
+    }
+}
+
+// Return buffers and file to context, also invoked when the constructor
+// fails
+void URingFileSink::Release() {
+    for (auto b : buffers_) context_->ReleaseBuffer(b);
+    buffers_.clear();
+    if (file_ >= 0) context_->ReleaseFile(file_);
+    file_ = -1;
+}
+
+}  // namespace sss
@@ -48,8 +48,10 @@
 
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <regex>
+#include <stdexcept>
 
 #include "utility.h"
 
@@ -69,6 +71,45 @@ size_t FileSize(const std::string& filename) {
 #endif
 }
 
+size_t ParseSize(const std::string& s) {
+    size_t pos = 0;
+    unsigned long long size = 0;
+    try {
+        size = std::stoull(s, &pos);
+    } catch (const std::exception&) {
+        throw std::invalid_argument("Invalid size " + s);
+    }
+    std::string unit = s.substr(pos);
+    if (unit == "B") unit.clear();
+    if (unit.size() > 1 && unit.substr(1) != "iB" && unit.substr(1) != "B") {
+        throw std::invalid_argument("Invalid size unit " + unit);
+    }
+    int shift = 0;
+    switch (unit.empty() ? ' ' : unit[0]) {
+        case ' ':
+            break;
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'M':
+            shift = 20;
+            break;
+        case 'G':
+            shift = 30;
+            break;
+        case 'T':
+            shift = 40;
+            break;
+        default:
+            throw std::invalid_argument("Invalid size unit " + unit);
+    }
+    if (size > (std::numeric_limits<size_t>::max() >> shift)) {
+        throw std::invalid_argument("Size too large " + s);
+    }
+    return size_t(size) << shift;
+}
+
 std::string GetHomeDir() {
     struct passwd* pw = getpwuid(getuid());
     return pw->pw_dir;
@@ -143,6 +184,7 @@ RandomIndex RandomRange(int lowerBound, int upperBound) {
     std::seed_seq seed{r(), r(), r(), r(), r(), r(), r(), r()}; 
     std::mt19937 e(seed);
     std::uniform_int_distribution<int> uniformDist(lowerBound, upperBound);
-    return [&]() { return uniformDist(e);};
+    // engine and distribution are owned by the returned function
+    return [e, uniformDist]() mutable { return uniformDist(e); };
 }
 } // namespace sss
\ No newline at end of file
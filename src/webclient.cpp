@@ -58,11 +58,61 @@ namespace sss {
 
 using namespace std;
 
-// Track number of instances created.
-std::atomic<int> WebClient::numInstances_{0};
-// Used to serialize access to init and cleanup libcurl functions, guaranteeing
-// tha only one init and one cleanup happens.
-std::mutex WebClient::cleanupMutex_;
+// Initializes libcurl on construction and cleans it up at program exit;
+// a single instance is created the first time a WebClient, ConnectionCache
+// or TransferEngine is created.
+// NOTE: libcurl initialization and cleanup are not thread safe, function
+// local statics are initialized only once even in case of concurrent calls.
+struct CurlGlobal {
+    CurlGlobal() {
+        // disable SIGPIPE signal, setting is process wide
+        struct sigaction sa{};
+        sa.sa_handler = SIG_IGN;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPIPE, &sa, NULL);
+        if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+            throw std::runtime_error("Cannot initialize libcurl");
+        }
+    }
+    ~CurlGlobal() { curl_global_cleanup(); }
+};
+
+// Per-thread pool of curl handles: handles are reset and reused instead of
+// being created and destroyed for each request, making construction and
+// destruction of WebClient instances lock free.
+class HandlePool {
+   public:
+    ~HandlePool() {
+        for (auto h : handles_) curl_easy_cleanup(h);
+    }
+    // Return handle from pool or create new one if pool is empty
+    CURL* Get() {
+        if (handles_.empty()) return curl_easy_init();
+        CURL* h = handles_.back();
+        handles_.pop_back();
+        return h;
+    }
+    // Reset handle and add to pool, base options are applied again by
+    // WebClient::Init() when the handle is reused
+    void Put(CURL* h) {
+        // detach from connection cache which might be destroyed before pool
+        curl_easy_setopt(h, CURLOPT_SHARE, NULL);
+        if (handles_.size() == MAX_HANDLES) {
+            curl_easy_cleanup(h);
+            return;
+        }
+        curl_easy_reset(h);
+        handles_.push_back(h);
+    }
+    static HandlePool& ForThread() {
+        thread_local HandlePool pool;
+        return pool;
+    }
+
+   private:
+    static const size_t MAX_HANDLES = 16;
+    std::vector<CURL*> handles_;
+};
 
 // All the following functions are invoked from libcurl and the FILE* pointer
 // is moved to the proper offset before the functions are passed to libcurl
@@ -99,28 +149,49 @@ size_t WriteFileUnbuffered(char* ptr, size_t size, size_t nmemb,
  */
 
 // public:
-/// Cleanup and invoke cleanup on libcurl in case of last instance
-WebClient::~WebClient() {
-    if (curlHeaderList_) {
-        curl_slist_free_all(curlHeaderList_);
-    }
-    if (curl_) {  // current object could have been moved
-        // libcurl init and cleanup functions ar NOT thread safe and the
-        // behaviour is unpredictable in case of use in a multithreaded
-        // environment, this just guarantees that there is only a single
-        // call to curl_global_cleanup
-        curl_easy_cleanup(curl_);
-        const std::lock_guard<std::mutex> lock(cleanupMutex_);
-        --numInstances_;
-        if (numInstances_ == 0) curl_global_cleanup();
-    }
+/// Cleanup and return handle to pool
+WebClient::~WebClient() { Release(); }
+// Release resources, then take over those of other as the move constructor
+// does
+WebClient& WebClient::operator=(WebClient&& other) {
+    if (this != &other) {
+        Release();
+        endpoint_ = other.endpoint_;
+        path_ = other.path_;
+        method_ = other.method_;
+        params_ = other.params_;
+        headers_ = other.headers_;
+        writeBuffer_ = other.writeBuffer_;
+        headerBuffer_ = other.headerBuffer_;
+        curl_ = other.curl_;
+        connectionCache_ = other.connectionCache_;
+        url_ = other.url_;
+        errorBuffer_ = other.errorBuffer_;
+        curlHeaderList_ = other.curlHeaderList_;
+        responseCode_ = other.responseCode_;
+        curlCode_ = other.curlCode_;
+        urlEncodedPostData_ = other.urlEncodedPostData_;
+        readBuffer_ = other.readBuffer_;
+        refBuffer_ = other.refBuffer_;
+        fileReadBuffer_ = other.fileReadBuffer_;
+        fileWriteBuffer_ = std::move(other.fileWriteBuffer_);
+        readAhead_ = std::move(other.readAhead_);
+        uringSource_ = std::move(other.uringSource_);
+        uringSink_ = std::move(other.uringSink_);
+        directSource_ = std::move(other.directSource_);
+        directSink_ = std::move(other.directSink_);
+        chunkedEncoder_ = std::move(other.chunkedEncoder_);
+        readFunction_ = other.readFunction_;
+        cancelled_ = other.cancelled_.load();
+        other.curl_ = NULL;
+        other.curlHeaderList_ = NULL;
+        other.fileReadBuffer_.fd = -1;
+        Rebind(other);
+    }
+    return *this;
 }
 // Send request
-bool WebClient::Send() {
-    const bool ret = Status(curl_easy_perform(curl_));
-    curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &responseCode_);
-    return ret;
-}
+bool WebClient::Send() { return Done(curl_easy_perform(curl_)); }
 // Set SSL verification options: peer and/or host
 // It is useful to disable everything when sending https requests through 
 // e.g. httos tunnel
@@ -161,6 +232,16 @@ void WebClient::SetHeaders(const Map& headers) {
     }
     curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, curlHeaderList_);
 }
+// Append header to libcurl list, the line is formatted into a per-thread
+// buffer which curl copies
+void WebClient::AddHeader(string_view name, string_view value) {
+    thread_local string line;
+    line.assign(name.data(), name.size());
+    line.append(": ");
+    line.append(value.data(), value.size());
+    curlHeaderList_ = curl_slist_append(curlHeaderList_, line.c_str());
+    curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, curlHeaderList_);
+}
 // Regenerate URL with new parameters
 void WebClient::SetReqParameters(const Map& params) {
     params_ = params;
@@ -210,6 +291,12 @@ void WebClient::SetPostData(const std::string& data) {
 }
 // Return status code of last executed request
 long WebClient::StatusCode() const { return responseCode_; }
+CURLcode WebClient::CurlCode() const { return curlCode_; }
+double WebClient::TransferTime() const {
+    double t = 0;
+    curl_easy_getinfo(curl_, CURLINFO_TOTAL_TIME, &t);
+    return t;
+}
 // Return full URL
 const std::string& WebClient::GetUrl() const { return url_; }
 // Return response content
@@ -226,6 +313,7 @@ bool WebClient::SetWriteFunction(WriteFunction f, void* ptr) {
         return false;
     if (curl_easy_setopt(curl_, CURLOPT_WRITEDATA, ptr) != CURLE_OK)
         return false;
+    writeData_ = ptr;
     return true;
 }
 // Set read function to use to read data to be sent
@@ -234,6 +322,8 @@ bool WebClient::SetReadFunction(ReadFunction f, void* ptr) {
         return false;
     if (curl_easy_setopt(curl_, CURLOPT_READDATA, ptr) != CURLE_OK)
         return false;
+    readFunction_ = f;
+    readData_ = ptr;
     return true;
 }
 // Fill buffer with data to be uploaded
@@ -265,17 +355,128 @@ bool WebClient::UploadFile(const std::string& fname, size_t fsize) {
 // Upload content from memory buffer, equivalent to uploading file from memory
 bool WebClient::UploadDataFromBuffer(const char* data, size_t offset,
                                      size_t size) {
-    if (curl_easy_setopt(curl_, CURLOPT_READFUNCTION, MemReader) != CURLE_OK) {
+    SetUploadBuffer(data + offset, size);
+    return Send();
+}
+// Configure upload from memory buffer, request is sent separately
+void WebClient::SetUploadBuffer(const char* data, size_t size) {
+    if (!SetReadFunction((ReadFunction)MemReader, &refBuffer_)) {
         throw std::runtime_error("Cannot set curl read function");
     }
-    if (curl_easy_setopt(curl_, CURLOPT_READDATA, &refBuffer_) != CURLE_OK) {
-        throw std::runtime_error("Cannot set curl read data buffer");
-    }
     refBuffer_.data = data;
-    refBuffer_.offset = offset;
+    refBuffer_.offset = 0;
     refBuffer_.size = size;
     SetMethod("PUT", size);
-    return Send();
+}
+// Wrap the configured read function into an encoder signing the payload
+// chunk by chunk or computing its checksum, the content length becomes the
+// encoded size
+void WebClient::SetChunkedEncoding(size_t chunkSize,
+                                   const SigV4Signer* signer) {
+    if (!readFunction_ || chunkedEncoder_) {
+        throw std::logic_error("No upload source or payload already encoded");
+    }
+    chunkedEncoder_.reset(
+        signer ? new AwsChunkedEncoder(*signer, headers_, chunkSize)
+               : new AwsChunkedEncoder(headers_, chunkSize));
+    chunkedEncoder_->SetSource(readFunction_, readData_);
+    if (!SetReadFunction((ReadFunction)ChunkedReader, chunkedEncoder_.get())) {
+        throw std::runtime_error("Cannot set read function");
+    }
+    curl_easy_setopt(curl_, CURLOPT_INFILESIZE_LARGE,
+                     curl_off_t(chunkedEncoder_->EncodedSize()));
+}
+// Configure upload of file region, request is sent separately
+void WebClient::SetUploadFile(const std::string& fname, size_t offset,
+                              size_t size, size_t readAhead) {
+    if (readAhead > 0) {
+        readAhead_.reset(new ReadAhead(fname, offset, size, readAhead));
+        if (!SetReadFunction((ReadFunction)ReadAheadReader, readAhead_.get())) {
+            throw std::runtime_error("Cannot set read function");
+        }
+        // fewer, larger reads from the slice buffers
+        curl_easy_setopt(curl_, CURLOPT_UPLOAD_BUFFERSIZE,
+                         long(std::min(readAhead, size_t(2) << 20)));
+        SetMethod("PUT", size);
+        return;
+    }
+    if (fileReadBuffer_.fd >= 0) close(fileReadBuffer_.fd);
+    fileReadBuffer_.fd = open(fname.c_str(), O_RDONLY | O_LARGEFILE);
+    if (fileReadBuffer_.fd < 0) {
+        throw std::runtime_error("Cannot open file " + fname + ": " +
+                                 strerror(errno));
+    }
+    fileReadBuffer_.offset = offset;
+    fileReadBuffer_.end = offset + size;
+    if (!SetReadFunction((ReadFunction)FileReader, &fileReadBuffer_)) {
+        throw std::runtime_error("Cannot set read function");
+    }
+    SetMethod("PUT", size);
+}
+// Configure download into file region written through pwrite
+void WebClient::SetDownloadFile(int fd, size_t offset, size_t bufferSize,
+                                std::function<size_t(size_t)> accept) {
+    fileWriteBuffer_.fd = fd;
+    fileWriteBuffer_.offset = offset;
+    fileWriteBuffer_.data.resize(std::max(bufferSize, size_t(1)));
+    fileWriteBuffer_.fill = 0;
+    fileWriteBuffer_.error = false;
+    fileWriteBuffer_.accept = std::move(accept);
+    fileWriteBuffer_.stopped = false;
+    fileWriteBuffer_.curl = curl_;
+    fileWriteBuffer_.status = 0;
+    fileWriteBuffer_.errorBody = &writeBuffer_;
+    writeBuffer_.data.clear();
+    if (!SetWriteFunction((WriteFunction)FileWriter, &fileWriteBuffer_)) {
+        throw std::runtime_error("Cannot set write function");
+    }
+}
+// Configure upload of file region read through io_uring
+void WebClient::SetUploadFileURing(const std::string& fname, size_t offset,
+                                   size_t size, size_t sliceSize,
+                                   bool direct) {
+    uringSource_.reset(
+        new URingFileSource(fname, offset, size, sliceSize, 4, direct));
+    if (!SetReadFunction((ReadFunction)URingReader, uringSource_.get())) {
+        throw std::runtime_error("Cannot set read function");
+    }
+    curl_easy_setopt(curl_, CURLOPT_UPLOAD_BUFFERSIZE,
+                     long(std::min(sliceSize, size_t(2) << 20)));
+    SetMethod("PUT", size);
+}
+// Configure download into file region written through io_uring
+void WebClient::SetDownloadFileURing(const std::string& fname, size_t offset,
+                                     size_t sliceSize, bool direct) {
+    uringSink_.reset(new URingFileSink(fname, offset, sliceSize, 4, direct));
+    if (!SetWriteFunction((WriteFunction)URingWriter, uringSink_.get())) {
+        throw std::runtime_error("Cannot set write function");
+    }
+}
+// Configure upload of file region read with O_DIRECT
+void WebClient::SetUploadFileDirect(const std::string& fname, size_t offset,
+                                    size_t size, BufferPool::Buffer buffer) {
+    const size_t sliceSize = buffer.Size();
+    directSource_.reset(
+        new DirectFileSource(fname, offset, size, std::move(buffer)));
+    if (!SetReadFunction((ReadFunction)DirectReader, directSource_.get())) {
+        throw std::runtime_error("Cannot set read function");
+    }
+    curl_easy_setopt(curl_, CURLOPT_UPLOAD_BUFFERSIZE,
+                     long(std::min(sliceSize, size_t(2) << 20)));
+    SetMethod("PUT", size);
+}
+// Configure download into file region written with O_DIRECT
+void WebClient::SetDownloadFileDirect(const std::string& fname, size_t offset,
+                                      BufferPool::Buffer buffer) {
+    directSink_.reset(new DirectFileSink(fname, offset, std::move(buffer)));
+    if (!SetWriteFunction((WriteFunction)DirectWriter, directSink_.get())) {
+        throw std::runtime_error("Cannot set write function");
+    }
+}
+// The sink stays in place, writes fail after the buffer is released
+BufferPool::Buffer WebClient::ReleaseDownloadBuffer() {
+    if (!directSink_) return {};
+    return directSink_->Release();
 }
 // Upload file starting at offset
 bool WebClient::UploadFile(const std::string& fname, size_t offset,
@@ -381,42 +582,90 @@ std::string WebClient::GetHeaderText() const {
 
 // private:
 
-// @warning !!!HACK Check status and discards SIGPIPE errors
-bool WebClient::Status(CURLcode cc) const {
-    if (cc == 0) return true;
-    // deal with "SSL_write() returned SYSCALL, errno = 32"
-    if (cc == CURLE_SEND_ERROR) {
-        const std::string err(begin(errorBuffer_), end(errorBuffer_));
-        if (err.find("32") != std::string::npos) return true;
-        if (ToUpper(err).find("PIPE") != std::string::npos) return true;
+// Check status
+bool WebClient::Status(CURLcode cc) const { return cc == CURLE_OK; }
+// Record outcome of completed transfer, invoked after curl_easy_perform or
+// by TransferEngine when the transfer has been completed by curl_multi.
+// The server can send a response and close the connection before the whole
+// request body is sent (e.g. "SSL_write() returned SYSCALL, errno = 32"):
+// the send error is ignored when a response has been received.
+bool WebClient::Done(CURLcode cc) {
+    curlCode_ = cc;
+    responseCode_ = 0;
+    curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &responseCode_);
+    if (writeData_ == &fileWriteBuffer_ && fileWriteBuffer_.stopped &&
+        cc == CURLE_WRITE_ERROR) {
+        // transfer stopped by write function, not an error
+        cc = curlCode_ = CURLE_OK;
+    }
+    // data received is only on disk after pending writes complete
+    if (((writeData_ == &fileWriteBuffer_ && !fileWriteBuffer_.Flush()) ||
+         (uringSink_ && !uringSink_->Finish()) ||
+         (directSink_ && !directSink_->Finish())) &&
+        cc == CURLE_OK) {
+        curlCode_ = CURLE_WRITE_ERROR;
+        return false;
+    }
+    return Status(cc) || (cc == CURLE_SEND_ERROR && responseCode_ > 0);
+}
+// Point libcurl to the buffers owned by this instance after a move
+void WebClient::Rebind(const WebClient& other) {
+    if (!curl_) return;
+    curl_easy_setopt(curl_, CURLOPT_ERRORBUFFER, errorBuffer_.data());
+    curl_easy_setopt(curl_, CURLOPT_HEADERDATA, &headerBuffer_);
+    if (other.writeData_ == &other.writeBuffer_) {
+        writeData_ = &writeBuffer_;
+    } else if (other.writeData_ == &other.fileWriteBuffer_) {
+        writeData_ = &fileWriteBuffer_;
+        fileWriteBuffer_.errorBody = &writeBuffer_;
+    } else {
+        writeData_ = other.writeData_;
+    }
+    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, writeData_);
+    auto own = [this, &other](void* data) -> void* {
+        if (data == &other.readBuffer_) return &readBuffer_;
+        if (data == &other.refBuffer_) return &refBuffer_;
+        if (data == &other.fileReadBuffer_) return &fileReadBuffer_;
+        return data;
+    };
+    readData_ = own(other.readData_);
+    curl_easy_setopt(curl_, CURLOPT_READDATA, readData_);
+    // the payload encoder reads from the source configured before it
+    if (chunkedEncoder_) {
+        chunkedEncoder_->SetSource(chunkedEncoder_->SourceFunction(),
+                                   own(chunkedEncoder_->SourceData()));
+    }
+    curl_easy_setopt(curl_, CURLOPT_XFERINFODATA, this);
+}
+// Free header list, close input file and return handle to pool
+void WebClient::Release() {
+    if (curlHeaderList_) {
+        curl_slist_free_all(curlHeaderList_);
+        curlHeaderList_ = NULL;
+    }
+    if (fileReadBuffer_.fd >= 0) {
+        close(fileReadBuffer_.fd);
+        fileReadBuffer_.fd = -1;
+    }
+    if (curl_) {  // current object could have been moved
+        HandlePool::ForThread().Put(curl_);
+        curl_ = NULL;
     }
-    return false;
 }
 // Initializes libcurl, makes sure curl_global_init() is called only by the
 // first instance
 void WebClient::InitEnv() {
-    //disable SIGPIPE signal per-thread
-    const struct sigaction sa{SIG_IGN};
-    sigaction(SIGPIPE, &sa, NULL);
-    // first thread initializes curl, the others wait until
-    // initialization is complete; the same mutex is used to initialize
-    // and cleanup, see ~WebClient().
-    // NOTE: libcurl initialization and cleanup are not thread safe,
-    // this code just guarantees that curl_global_init is called only
-    // once
-    const std::lock_guard<std::mutex> lock(cleanupMutex_);
-    if (numInstances_ == 0) {
-        if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
-            throw std::runtime_error("Cannot initialize libcurl");
-        }
-    }
-    ++numInstances_;
+    GlobalInit();
     Init();
 }
-// Initialize curl internal state
+// First caller initializes curl, the others wait until initialization is
+// complete; also invoked by TransferEngine and ConnectionCache which need
+// libcurl to be initialized before creating multi and share handles
+void WebClient::GlobalInit() { static const CurlGlobal curlGlobal; }
+// Initialize curl internal state, handle is taken from per-thread pool and
+// options are applied on top of the defaults set by curl_easy_reset
 bool WebClient::Init() {
-    curl_ = curl_easy_init();
-    // curl_easy_setopt(curl_, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+    curl_ = HandlePool::ForThread().Get();
     if (!curl_) {
         throw(std::runtime_error("Cannot create Curl connection"));
         return false;
@@ -424,16 +673,24 @@ bool WebClient::Init() {
     if (curl_easy_setopt(curl_, CURLOPT_ERRORBUFFER, errorBuffer_.data()) !=
         CURLE_OK)
         goto handle_error;
+    // reuse connections, DNS entries and TLS sessions
+    connectionCache_ = ConnectionCache::ForThread();
+    if (curl_easy_setopt(curl_, CURLOPT_SHARE, connectionCache_->Handle()) !=
+        CURLE_OK)
+        goto handle_error;
     if (curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1L) != CURLE_OK)
         goto handle_error;
     if (curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, Writer) != CURLE_OK)
         goto handle_error;
     if (curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &writeBuffer_) != CURLE_OK)
         goto handle_error;
+    writeData_ = &writeBuffer_;
     if (curl_easy_setopt(curl_, CURLOPT_READFUNCTION, Reader) != CURLE_OK)
         goto handle_error;
     if (curl_easy_setopt(curl_, CURLOPT_READDATA, &readBuffer_) != CURLE_OK)
         goto handle_error;
+    readFunction_ = (ReadFunction)Reader;
+    readData_ = &readBuffer_;
     if (curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, HeaderWriter) !=
         CURLE_OK)
         goto handle_error;
@@ -443,9 +700,17 @@ bool WebClient::Init() {
     if (curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L) != CURLE_OK) {
         goto handle_error;
     }
-    if (curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 1L) != CURLE_OK) {
+    // progress function is only used to cancel transfers
+    if (curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 0L) != CURLE_OK) {
         goto handle_error;
     };
+    if (curl_easy_setopt(curl_, CURLOPT_XFERINFOFUNCTION, Progress) !=
+        CURLE_OK) {
+        goto handle_error;
+    }
+    if (curl_easy_setopt(curl_, CURLOPT_XFERINFODATA, this) != CURLE_OK) {
+        goto handle_error;
+    }
     if(curl_easy_setopt(curl_, CURLOPT_ACCEPT_ENCODING, "") != CURLE_OK){
         goto handle_error;
     }
@@ -461,8 +726,6 @@ bool WebClient::Init() {
     if (!endpoint_.empty()) {
         BuildURL();
     }
-    signal(SIGPIPE, SIG_IGN);
-    curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L);
     return true;
 handle_error:
     throw(std::runtime_error(errorBuffer_.data()));
@@ -522,7 +785,7 @@ size_t WebClient::MemReader(void* ptr, size_t size, size_t nmemb,
     // start element
     const auto b = inBuffer->data + inBuffer->offset;
     // one past last element
-    const auto end = inBuffer->data + inBuffer->offset + inBuffer->size;
+    const auto end = inBuffer->data + inBuffer->size;
     if (b >= end) {
         return 0;  // 0 marks the end of buffer
     }
@@ -537,11 +800,148 @@ size_t WebClient::MemReader(void* ptr, size_t size, size_t nmemb,
     inBuffer->offset += size;
     return size;
 }
+// Read file region through pread, file position is tracked in buffer object
+// so that multiple clients can share the same file
+size_t WebClient::FileReader(void* ptr, size_t size, size_t nmemb,
+                             FileReadBuffer* inBuffer) {
+    size = min(size * nmemb, inBuffer->end - inBuffer->offset);
+    if (size == 0) return 0;
+    const ssize_t r = pread(inBuffer->fd, ptr, size, inBuffer->offset);
+    if (r < 0) return CURL_READFUNC_ABORT;
+    inBuffer->offset += size_t(r);
+    return size_t(r);
+}
+// Progress function, a non-zero value aborts the transfer
+int WebClient::Progress(WebClient* client, curl_off_t, curl_off_t, curl_off_t,
+                        curl_off_t) {
+    return client->cancelled_ ? 1 : 0;
+}
+// Copy received data into buffer, writing it to file when full
+size_t WebClient::FileWriter(char* data, size_t size, size_t nmemb,
+                             FileWriteBuffer* outBuffer) {
+    const size_t total = size * nmemb;
+    // an error response body is not part of the file: it is kept, up to
+    // 64 KiB, for GetContentText() without consuming the range
+    if (outBuffer->status == 0) {
+        curl_easy_getinfo(outBuffer->curl, CURLINFO_RESPONSE_CODE,
+                          &outBuffer->status);
+    }
+    if (outBuffer->status < 200 || outBuffer->status >= 300) {
+        vector<uint8_t>& body = outBuffer->errorBody->data;
+        const size_t n = min(total, (size_t(64) << 10) -
+                                        min(body.size(), size_t(64) << 10));
+        body.insert(body.end(), data, data + n);
+        return total;
+    }
+    const size_t accepted =
+        outBuffer->accept ? outBuffer->accept(total) : total;
+    size = accepted;
+    while (size > 0) {
+        const size_t n =
+            min(size, outBuffer->data.size() - outBuffer->fill);
+        memcpy(outBuffer->data.data() + outBuffer->fill, data, n);
+        outBuffer->fill += n;
+        data += n;
+        size -= n;
+        // returning less than the received size aborts the transfer
+        if (outBuffer->fill == outBuffer->data.size() && !outBuffer->Flush())
+            return 0;
+    }
+    // stop transfer, buffered data is written by Done()
+    if (accepted < total) {
+        outBuffer->stopped = true;
+        return 0;
+    }
+    return total;
+}
+// Write buffer at current offset and move offset past written data
+bool WebClient::FileWriteBuffer::Flush() {
+    const char* p = data.data();
+    while (fill > 0 && !error) {
+        const ssize_t r = pwrite(fd, p, fill, offset);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            error = true;
+            break;
+        }
+        p += r;
+        fill -= size_t(r);
+        offset += size_t(r);
+    }
+    return !error;
+}
+// Read file region from read-ahead buffers
+size_t WebClient::ReadAheadReader(void* ptr, size_t size, size_t nmemb,
+                                  ReadAhead* readAhead) {
+    const ssize_t r = readAhead->Read(static_cast<char*>(ptr), size * nmemb);
+    return r < 0 ? CURL_READFUNC_ABORT : size_t(r);
+}
+// Read file region from io_uring buffers
+size_t WebClient::URingReader(void* ptr, size_t size, size_t nmemb,
+                              URingFileSource* source) {
+    const ssize_t r = source->Read(static_cast<char*>(ptr), size * nmemb);
+    return r < 0 ? CURL_READFUNC_ABORT : size_t(r);
+}
+// Write received data through io_uring, returning less than the received
+// size makes libcurl abort the transfer
+size_t WebClient::URingWriter(char* data, size_t size, size_t nmemb,
+                              URingFileSink* sink) {
+    return sink->Write(data, size * nmemb) ? size * nmemb : 0;
+}
+// Read file region through O_DIRECT buffer
+size_t WebClient::DirectReader(void* ptr, size_t size, size_t nmemb,
+                               DirectFileSource* source) {
+    const ssize_t r = source->Read(static_cast<char*>(ptr), size * nmemb);
+    return r < 0 ? CURL_READFUNC_ABORT : size_t(r);
+}
+// Write received data through O_DIRECT buffer
+size_t WebClient::DirectWriter(char* data, size_t size, size_t nmemb,
+                               DirectFileSink* sink) {
+    return sink->Write(data, size * nmemb) ? size * nmemb : 0;
+}
+// Read payload encoded chunk by chunk
+size_t WebClient::ChunkedReader(void* ptr, size_t size, size_t nmemb,
+                                AwsChunkedEncoder* encoder) {
+    const ssize_t r = encoder->Read(static_cast<char*>(ptr), size * nmemb);
+    return r < 0 ? CURL_READFUNC_ABORT : size_t(r);
+}
 
 // Redirect stderr to file. Returns \c false when it fails.
 bool WebClient::RedirectSTDErr(FILE* f) {
     return curl_easy_setopt(curl_, CURLOPT_STDERR, f) == CURLE_OK;
 }
+// Set HTTP version; with HTTP/2 wait for connections to be multiplexed instead
+// of opening new ones
+bool WebClient::SetHTTPVersion(HTTPVersion version) {
+    long v = CURL_HTTP_VERSION_NONE;
+    switch (version) {
+        case HTTPVersion::DEFAULT:
+            break;
+        case HTTPVersion::HTTP_1_1:
+            v = CURL_HTTP_VERSION_1_1;
+            break;
+        case HTTPVersion::HTTP_2:
+            v = CURL_HTTP_VERSION_2_0;
+            break;
+        case HTTPVersion::HTTP_2_PRIOR_KNOWLEDGE:
+            v = CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+            break;
+    }
+    const bool http2 = version == HTTPVersion::HTTP_2 ||
+                       version == HTTPVersion::HTTP_2_PRIOR_KNOWLEDGE;
+    return Status(curl_easy_setopt(curl_, CURLOPT_HTTP_VERSION, v)) &&
+           Status(curl_easy_setopt(curl_, CURLOPT_PIPEWAIT, http2 ? 1L : 0L));
+}
+
+// Convert text to HTTPVersion
+HTTPVersion ParseHTTPVersion(const std::string& v) {
+    if (v.empty()) return HTTPVersion::DEFAULT;
+    if (v == "1.1") return HTTPVersion::HTTP_1_1;
+    if (v == "2") return HTTPVersion::HTTP_2;
+    if (v == "h2c") return HTTPVersion::HTTP_2_PRIOR_KNOWLEDGE;
+    throw std::invalid_argument("Invalid HTTP version " + v +
+                                ", must be one of '1.1', '2', 'h2c'");
+}
 
 
 }  // namespace sss
\ No newline at end of file